@@ -0,0 +1,173 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstddef>
+
+/**
+	A ChunkedArray is an append-only array that can be read by any number of threads
+	while a single thread appends to it. Elements are stored in fixed-size chunks that
+	never move once allocated, so a reference to an element stays valid for the life
+	of the array and readers never see a reallocation.
+
+	Appended elements are published by storing the new size with release semantics.
+	A reader that loads the size sees every element below it fully written, and the
+	elements below a size it has seen never change. Reading needs no lock: it loads
+	the current chunk directory and indexes into a chunk.
+
+	The chunk directory doubles when it runs out of room. The old directories are kept
+	until the array is destroyed, since a reader may still be looking through one.
+*/
+template <typename T>
+class ChunkedArray
+{
+public:
+	/**
+		Each chunk holds 2^chunkShift elements.
+	*/
+	static const size_t chunkShift = 16;
+	static const size_t chunkSize = size_t(1) << chunkShift;
+
+	ChunkedArray() : directory(nullptr), numElements(0), directoryCapacity(0)
+	{
+	}
+
+	ChunkedArray(const ChunkedArray&) = delete;
+	ChunkedArray& operator=(const ChunkedArray&) = delete;
+
+	/**
+		Returns the element at the given index, which must be below a size this thread
+		has loaded. This may be called from any thread.
+	*/
+	const T& operator[](size_t index) const
+	{
+		T* const* chunkDirectory = directory.load(std::memory_order_acquire);
+
+		return chunkDirectory[index >> chunkShift][index & (chunkSize - 1)];
+	}
+
+	/**
+		Returns the number of published elements. This may be called from any thread.
+	*/
+	size_t size() const
+	{
+		return numElements.load(std::memory_order_acquire);
+	}
+
+	/**
+		Returns the number of elements that fit in the allocated chunks. Only the
+		writing thread may call this.
+	*/
+	size_t capacity() const
+	{
+		return chunks.size() << chunkShift;
+	}
+
+	/**
+		Allocates chunks for at least numElements elements. Only the writing thread may
+		call this.
+	*/
+	void reserve(size_t numElements)
+	{
+		while (capacity() < numElements)
+		{
+			addChunk();
+		}
+	}
+
+	/**
+		Appends an element and publishes it. Only the writing thread may call this.
+	*/
+	void push_back(const T& value)
+	{
+		size_t index = numElements.load(std::memory_order_relaxed);
+
+		if (index == capacity())
+		{
+			addChunk();
+		}
+
+		chunks[index >> chunkShift][index & (chunkSize - 1)] = value;
+
+		numElements.store(index + 1, std::memory_order_release);
+	}
+
+	/**
+		Appends a range of elements and publishes them all at once. Only the writing
+		thread may call this.
+	*/
+	template <typename Iterator>
+	void append(Iterator first, Iterator last)
+	{
+		size_t index = numElements.load(std::memory_order_relaxed);
+
+		for (; first != last; ++first, index++)
+		{
+			if (index == capacity())
+			{
+				addChunk();
+			}
+
+			chunks[index >> chunkShift][index & (chunkSize - 1)] = *first;
+		}
+
+		numElements.store(index, std::memory_order_release);
+	}
+
+private:
+	/**
+		Allocates a new chunk and adds it to the directory, replacing the directory with
+		one twice its size if it is full.
+	*/
+	void addChunk()
+	{
+		if (chunks.size() == directoryCapacity)
+		{
+			directoryCapacity = std::max<size_t>(16, 2 * directoryCapacity);
+
+			std::unique_ptr<T*[]> grown(new T*[directoryCapacity]);
+
+			for (size_t index = 0; index < chunks.size(); index++)
+			{
+				grown[index] = chunks[index].get();
+			}
+
+			directory.store(grown.get(), std::memory_order_release);
+			directories.push_back(std::move(grown));
+		}
+
+		/*
+			The new slot is beyond every published element, so no reader looks at it
+			until the size covering it is published.
+		*/
+		chunks.push_back(std::unique_ptr<T[]>(new T[chunkSize]));
+		directories.back()[chunks.size() - 1] = chunks.back().get();
+	}
+
+	/**
+		The current chunk directory, which readers index into.
+	*/
+	std::atomic<T**> directory;
+
+	/**
+		The number of published elements.
+	*/
+	std::atomic<size_t> numElements;
+
+	/**
+		The number of chunk pointers the current directory has room for.
+	*/
+	size_t directoryCapacity;
+
+	/**
+		The allocated chunks in order. Only the writer uses this list.
+	*/
+	std::vector<std::unique_ptr<T[]>> chunks;
+
+	/**
+		Every directory that has been published, the current one last.
+	*/
+	std::vector<std::unique_ptr<T*[]>> directories;
+};
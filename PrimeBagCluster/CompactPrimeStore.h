@@ -0,0 +1,371 @@
+#pragma once
+
+#include "PrimeFile.h"
+#include "ChunkedArray.h"
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <iterator>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+typedef unsigned int uint;
+
+/**
+	A CompactPrimeStore holds an ordered list of prime numbers in about a quarter of the
+	memory of a PrimeStore. Every prime p is represented by h = (p - 1) / 2, so that 2 is
+	0, 3 is 1, 5 is 2, and each prime is stored as the difference to the previous h.
+	Below 2^32 these differences, half the prime gaps, fit in one byte. Larger ones are
+	stored as a zero byte followed by a variable length integer.
+
+	Every 64th prime is sampled together with the position of its successor in the byte
+	stream, so any prime can be found by decoding at most 63 differences. Sequential
+	scans should use the const_iterator, which decodes one difference per step.
+
+	Like a PrimeStore, one thread may append primes while other threads read them. 
+	The byte stream and the samples are kept in chunked arrays that never reallocate,
+	and a prime only becomes visible through size() once its bytes are written.
+
+	The type parameter P is the word type of the stored primes.
+*/
+template <typename P>
+class CompactPrimeStore
+{
+public:
+	typedef P value_type;
+
+	/**
+		The number of primes between two samples.
+	*/
+	static const size_t sampleInterval = 64;
+
+	/**
+		This is a cursor over the primes of a store. Moving forward decodes a single
+		difference. Moving backward or jumping seeks from the nearest sample.
+	*/
+	class const_iterator
+	{
+	public:
+		typedef std::bidirectional_iterator_tag iterator_category;
+		typedef P value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const P* pointer;
+		typedef P reference;
+
+		const_iterator(const CompactPrimeStore* store = nullptr, size_t index = 0)
+			: store(store), index(index), offset(0), half(0)
+		{
+			if (store && index < store->size())
+			{
+				store->seek(index, offset, half);
+			}
+		}
+
+		P operator*() const
+		{
+			return decode(half);
+		}
+
+		const_iterator& operator++()
+		{
+			if (++index < store->size())
+			{
+				half += store->readDifference(offset);
+			}
+
+			return *this;
+		}
+
+		const_iterator operator++(int)
+		{
+			const_iterator copy = *this;
+			++*this;
+			return copy;
+		}
+
+		const_iterator& operator--()
+		{
+			*this = const_iterator(store, index - 1);
+			return *this;
+		}
+
+		const_iterator operator--(int)
+		{
+			const_iterator copy = *this;
+			--*this;
+			return copy;
+		}
+
+		const_iterator operator+(difference_type distance) const
+		{
+			return const_iterator(store, index + distance);
+		}
+
+		const_iterator operator-(difference_type distance) const
+		{
+			return const_iterator(store, index - distance);
+		}
+
+		difference_type operator-(const const_iterator& other) const
+		{
+			return difference_type(index) - difference_type(other.index);
+		}
+
+		bool operator==(const const_iterator& other) const
+		{
+			return index == other.index;
+		}
+
+		bool operator!=(const const_iterator& other) const
+		{
+			return index != other.index;
+		}
+
+	private:
+		const CompactPrimeStore* store;
+		size_t index;
+
+		/**
+			The position in the byte stream of the difference to the next prime.
+		*/
+		size_t offset;
+
+		/**
+			The h value of the current prime.
+		*/
+		P half;
+	};
+
+	/**
+		This constructor creates an empty store.
+	*/
+	CompactPrimeStore() : numPrimes(0), lastHalf(0), reserved(0)
+	{
+	}
+
+	/**
+		This constructor creates a store containing the primes of a mapped prime file.
+		The primes are compressed into memory, so the mapping is not kept. Throws
+		std::runtime_error if the file stores primes of a different word size.
+	*/
+	CompactPrimeStore(std::shared_ptr<const PrimeFile> file) : CompactPrimeStore()
+	{
+		const P* primes = file->getPrimes<P>();
+
+		reserve(file->getNumPrimes());
+		append(primes, primes + file->getNumPrimes());
+	}
+
+	/**
+		Returns the prime number at the given index.
+	*/
+	P operator[](size_t index) const
+	{
+		size_t offset;
+		P half;
+
+		seek(index, offset, half);
+
+		return decode(half);
+	}
+
+	/**
+		Returns the number of primes in the store.
+	*/
+	size_t size() const
+	{
+		return numPrimes.load(std::memory_order_acquire);
+	}
+
+	bool empty() const
+	{
+		return !size();
+	}
+
+	P back() const
+	{
+		return (*this)[size() - 1];
+	}
+
+	const_iterator begin() const
+	{
+		return const_iterator(this, 0);
+	}
+
+	const_iterator end() const
+	{
+		return const_iterator(this, size());
+	}
+
+	/**
+		Returns the number of primes the store has reserved memory for.
+	*/
+	size_t capacity() const
+	{
+		return std::max(reserved, size());
+	}
+
+	/**
+		Reserves memory for numPrimes primes, assuming that almost all of them take a
+		single byte.
+	*/
+	void reserve(size_t numPrimes)
+	{
+		if (numPrimes > reserved)
+		{
+			differences.reserve(numPrimes + numPrimes / 64);
+			samples.reserve(numPrimes / sampleInterval + 1);
+			reserved = numPrimes;
+		}
+	}
+
+	void push_back(P prime)
+	{
+		P half = (prime - 1) / 2;
+		size_t index = numPrimes.load(std::memory_order_relaxed);
+
+		if (index)
+		{
+			writeDifference(half - lastHalf);
+		}
+
+		if (index % sampleInterval == 0)
+		{
+			samples.push_back(Sample{ half, differences.size() });
+		}
+
+		lastHalf = half;
+		numPrimes.store(index + 1, std::memory_order_release);
+	}
+
+	/**
+		Appends an ordered range of primes that are all larger than the last prime.
+	*/
+	template <typename Iterator>
+	void append(Iterator first, Iterator last)
+	{
+		for (; first != last; ++first)
+		{
+			push_back(*first);
+		}
+	}
+
+	/**
+		Returns the number of bytes used to hold the primes.
+	*/
+	size_t getMemoryUsage() const
+	{
+		return differences.size() + samples.size() * sizeof(Sample);
+	}
+
+private:
+	/**
+		A sampled prime and the position of the difference to its successor.
+	*/
+	struct Sample
+	{
+		P half;
+		size_t offset;
+	};
+
+	/**
+		Converts an h value back into its prime.
+	*/
+	static P decode(P half)
+	{
+		return half ? 2 * half + 1 : 2;
+	}
+
+	/**
+		Finds the h value of the prime at an index and the position of the difference
+		to the prime after it.
+	*/
+	void seek(size_t index, size_t& offset, P& half) const
+	{
+		const Sample& sample = samples[index / sampleInterval];
+
+		offset = sample.offset;
+		half = sample.half;
+
+		for (size_t step = index % sampleInterval; step; step--)
+		{
+			half += readDifference(offset);
+		}
+	}
+
+	/**
+		Reads the difference at offset and moves offset past it.
+	*/
+	P readDifference(size_t& offset) const
+	{
+		uint8_t byte = differences[offset++];
+
+		if (byte)
+		{
+			return byte;
+		}
+
+		/*
+			A zero byte is followed by the difference in 7-bit groups, lowest first.
+		*/
+		P difference = 0;
+		uint shift = 0;
+
+		do
+		{
+			byte = differences[offset++];
+			difference |= P(byte & 0x7F) << shift;
+			shift += 7;
+		} while (byte & 0x80);
+
+		return difference;
+	}
+
+	/**
+		Appends a difference to the byte stream.
+	*/
+	void writeDifference(P difference)
+	{
+		if (difference < 256)
+		{
+			differences.push_back(uint8_t(difference));
+			return;
+		}
+
+		differences.push_back(0);
+
+		while (difference >= 0x80)
+		{
+			differences.push_back(uint8_t(difference | 0x80));
+			difference >>= 7;
+		}
+
+		differences.push_back(uint8_t(difference));
+	}
+
+	/**
+		The differences between consecutive h values.
+	*/
+	ChunkedArray<uint8_t> differences;
+
+	/**
+		Every 64th prime, starting with the first.
+	*/
+	ChunkedArray<Sample> samples;
+
+	/**
+		The number of published primes.
+	*/
+	std::atomic<size_t> numPrimes;
+
+	/**
+		The h value of the last prime. Only the writing thread uses it.
+	*/
+	P lastHalf;
+
+	/**
+		The number of primes memory has been reserved for.
+	*/
+	size_t reserved;
+};
@@ -0,0 +1,512 @@
+#pragma once
+
+#include "PrimeSource.h"
+#include "TransparentHash.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/**
+	A ConcurrentPrimeTable assigns unique prime numbers to values like a PrimeTable,
+	but any number of threads can add values and look them up at the same time.
+
+	The values are split into shards by their hash. Each shard is an open addressing
+	table of indices into the list of prime numbers, and adding a value only locks
+	the shard it falls into, so producers that add different values rarely wait for
+	each other. The index of a new value is taken from an atomic cursor, and its prime
+	is read from the shared PrimeSource, which hands out calculated primes without a
+	lock. The values themselves are stored at the index of their prime in chunks that
+	never move.
+
+	Reading never locks or retries. getPrime probes one shard table a bounded number
+	of times, and getValue searches the calculated primes and reads a chunk. A value
+	and its prime are published with release semantics once they are fully written,
+	so a reader either does not find a value that is being added or sees all of it.
+	A shard table that has grown is kept until the table is destroyed, since a reader
+	may still be probing it.
+
+	Unlike a PrimeTable, this table only grows. Values cannot be removed, reranked or
+	referenced by bags, since any of those would move values under the readers. The
+	primes are handed out in the order the values win their shard lock, so they are
+	dense but not in input order.
+
+	Like in a PrimeTable, values can be looked up by any key that compares equal to
+	V and hashes alike under TransparentHash<V>.
+
+	The type parameters are those of PrimeTable.
+*/
+template <typename V, typename P = uint32_t, typename Store = PrimeStore<P>>
+class ConcurrentPrimeTable
+{
+public:
+	typedef V value_type;
+	typedef P prime_type;
+	typedef Store store_type;
+
+	/**
+		Each chunk of values holds 2^chunkShift values, and the table holds at most
+		maxChunks chunks.
+	*/
+	static const size_t chunkShift = 16;
+	static const size_t chunkSize = size_t(1) << chunkShift;
+	static const size_t maxChunks = size_t(1) << 16;
+
+	/**
+		This constructor creates a table on a prime source, by default the process-wide
+		one, with numShards shards. The number of shards is rounded up to a power of
+		two, and should be a few times the number of threads that add values.
+	*/
+	ConcurrentPrimeTable(std::shared_ptr<PrimeSource<P, Store>> source = PrimeSource<P, Store>::getShared(), size_t numShards = 64)
+		: source(source), chunks(new std::atomic<Chunk*>[maxChunks]()), nextIndex(0), numValues(0)
+	{
+		this->numShards = 1;
+
+		while (this->numShards < numShards)
+		{
+			this->numShards *= 2;
+		}
+
+		shards.reset(new Shard[this->numShards]);
+	}
+
+	ConcurrentPrimeTable(const ConcurrentPrimeTable&) = delete;
+	ConcurrentPrimeTable& operator=(const ConcurrentPrimeTable&) = delete;
+
+	~ConcurrentPrimeTable()
+	{
+		for (size_t chunk = 0; chunk < maxChunks; chunk++)
+		{
+			delete chunks[chunk].load(std::memory_order_relaxed);
+		}
+	}
+
+	/**
+		Adds a value to the table and assigns it a unique prime number, unless it has
+		one already. Returns the prime number associated with the value. This may be
+		called from any thread. Throws std::overflow_error if the prime does not fit
+		in P or the table is full.
+	*/
+	P add(const V& value)
+	{
+		uint64_t hash = hashValue(value);
+		Shard& shard = shards[size_t(hash) & (numShards - 1)];
+
+		P prime = find(shard, hash, value);
+
+		if (prime)
+		{
+			return prime;
+		}
+
+		std::lock_guard<std::mutex> lock(shard.mutex);
+
+		/*
+			Look again, since another thread may have added the value while this one
+			waited for the lock. The slot the search ends on is where the value goes.
+		*/
+		SlotTable* table = shard.table.load(std::memory_order_relaxed);
+		size_t position = 0;
+
+		if (table)
+		{
+			for (position = getHome(table, hash); ; position = (position + 1) & table->mask)
+			{
+				P slot = table->slots[position].load(std::memory_order_relaxed);
+
+				if (!slot)
+				{
+					break;
+				}
+
+				if (getChunk(slot - 1).values[(slot - 1) & (chunkSize - 1)] == value)
+				{
+					return getPrimeAt(slot - 1);
+				}
+			}
+		}
+
+		/*
+			Claim the next index only once its prime is known, so that a table that is
+			full or a source that runs out of primes throws without using it up. Another
+			shard may claim the index first, in which case the next one is tried.
+		*/
+		size_t index = nextIndex.load();
+
+		do
+		{
+			if (index >= maxChunks * chunkSize)
+			{
+				throw std::overflow_error("The table is full.");
+			}
+
+			prime = source->getPrimeNumber(index);
+		}
+		while (!nextIndex.compare_exchange_weak(index, index + 1));
+
+		Chunk& chunk = allocateChunk(index);
+		chunk.values[index & (chunkSize - 1)] = value;
+		chunk.assigned[index & (chunkSize - 1)].store(true, std::memory_order_release);
+
+		/*
+			Keep the shard table at most half full, so that probes stay short.
+		*/
+		if (!table || 2 * (shard.numValues + 1) > table->mask + 1)
+		{
+			table = grow(shard);
+
+			for (position = getHome(table, hash); table->slots[position].load(std::memory_order_relaxed); position = (position + 1) & table->mask)
+			{
+			}
+		}
+
+		table->slots[position].store(P(index + 1), std::memory_order_release);
+		shard.numValues++;
+		numValues.fetch_add(1, std::memory_order_relaxed);
+
+		return prime;
+	}
+
+	/**
+		Returns the prime number associated with a value. Returns 0 if it could not be
+		found. This may be called from any thread and never waits.
+	*/
+	template <typename Key>
+	P getPrime(const Key& value) const
+	{
+		uint64_t hash = hashValue(value);
+
+		return find(shards[size_t(hash) & (numShards - 1)], hash, value);
+	}
+
+	/**
+		Returns the value associated with a given prime number. This may be called from
+		any thread and never waits. Throws std::out_of_range if the given prime is not
+		assigned to a value.
+	*/
+	const V& getValue(P prime) const
+	{
+		return getValueAt(getPrimeIndex(prime));
+	}
+
+	/**
+		Returns the value associated with the prime at an index into the list of
+		prime numbers. Throws std::out_of_range if that prime is not assigned to a
+		value.
+	*/
+	const V& getValueAt(size_t index) const
+	{
+		if (!containsIndex(index))
+		{
+			throw std::out_of_range("The prime is not assigned to a value.");
+		}
+
+		return getChunk(index).values[index & (chunkSize - 1)];
+	}
+
+	/**
+		Returns whether or not a prime number has been assigned to a value in this
+		table.
+	*/
+	bool containsPrime(P prime) const
+	{
+		return containsIndex(getPrimeIndex(prime));
+	}
+
+	/**
+		Returns whether or not the prime at an index into the list of prime numbers
+		has been assigned to a value in this table.
+	*/
+	bool containsIndex(size_t index) const
+	{
+		if (index >= maxChunks * chunkSize)
+		{
+			return false;
+		}
+
+		const Chunk* chunk = chunks[index >> chunkShift].load(std::memory_order_acquire);
+
+		return chunk && chunk->assigned[index & (chunkSize - 1)].load(std::memory_order_acquire);
+	}
+
+	/**
+		Returns the index of a prime number into the list of prime numbers. Only the
+		primes up to the largest one this table has handed out are searched, and the
+		number of those is returned if the given number is not one of them.
+	*/
+	size_t getPrimeIndex(P prime) const
+	{
+		const Store& primes = source->getCalculatedPrimes();
+		size_t end = std::min<size_t>(nextIndex.load(), primes.size());
+
+		/*
+			The stores only guarantee fast indexing, so this is a binary search by
+			index rather than std::lower_bound.
+		*/
+		size_t first = 0;
+		size_t last = end;
+
+		while (first < last)
+		{
+			size_t middle = first + (last - first) / 2;
+
+			if (primes[middle] < prime)
+			{
+				first = middle + 1;
+			}
+			else
+			{
+				last = middle;
+			}
+		}
+
+		return first < end && primes[first] == prime ? first : end;
+	}
+
+	/**
+		Calculates the primes for numValues values ahead of time, so that the threads
+		adding them never have to wait for the sieve.
+	*/
+	void reserve(size_t numValues)
+	{
+		if (numValues)
+		{
+			source->getPrimeNumber(numValues - 1);
+		}
+	}
+
+	/**
+		Returns the number of values in the table. While values are being added, this
+		may lag behind what getPrime finds.
+	*/
+	size_t size() const
+	{
+		return numValues.load(std::memory_order_relaxed);
+	}
+
+	/**
+		Returns a list of all calculated prime numbers.
+	*/
+	const Store& getPrimeNumbers() const
+	{
+		return source->getCalculatedPrimes();
+	}
+
+	/**
+		Returns the prime source of this table.
+	*/
+	std::shared_ptr<PrimeSource<P, Store>> getPrimeSource() const
+	{
+		return source;
+	}
+
+private:
+	/**
+		A chunk of values and a flag for each one that is set once the value at that
+		position has been written.
+	*/
+	struct Chunk
+	{
+		Chunk()
+		{
+			for (size_t position = 0; position < chunkSize; position++)
+			{
+				assigned[position].store(false, std::memory_order_relaxed);
+			}
+		}
+
+		V values[chunkSize];
+		std::atomic<bool> assigned[chunkSize];
+	};
+
+	/**
+		An open addressing table of a shard. A slot holds 1 more than the index of a
+		value, or 0 if it is empty. The number of slots is a power of two.
+	*/
+	struct SlotTable
+	{
+		SlotTable(size_t numSlots) : mask(numSlots - 1), slots(new std::atomic<P>[numSlots]())
+		{
+		}
+
+		size_t mask;
+		std::unique_ptr<std::atomic<P>[]> slots;
+	};
+
+	/**
+		A shard is aligned to a cache line, so that threads adding to different
+		shards do not share one.
+	*/
+	struct alignas(64) Shard
+	{
+		Shard() : table(nullptr), numValues(0)
+		{
+		}
+
+		/**
+			This mutex is held while a value is added to the shard.
+		*/
+		std::mutex mutex;
+
+		/**
+			The current table, which readers probe.
+		*/
+		std::atomic<SlotTable*> table;
+
+		size_t numValues;
+
+		/**
+			Every table this shard has had, the current one last.
+		*/
+		std::vector<std::unique_ptr<SlotTable>> tables;
+	};
+
+	/**
+		Mixes the bits of the hash of a value. The low bits pick the shard and the
+		bits above them the slot.
+	*/
+	template <typename Key>
+	static uint64_t hashValue(const Key& value)
+	{
+		uint64_t hash = uint64_t(TransparentHash<V>()(value));
+
+		hash ^= hash >> 33;
+		hash *= 0xFF51AFD7ED558CCDull;
+		hash ^= hash >> 33;
+
+		return hash;
+	}
+
+	size_t getHome(const SlotTable* table, uint64_t hash) const
+	{
+		return size_t(hash >> 16) & table->mask;
+	}
+
+	/**
+		Returns the prime of a value in a shard, or 0 if it is not there. This does not
+		lock the shard.
+	*/
+	template <typename Key>
+	P find(const Shard& shard, uint64_t hash, const Key& value) const
+	{
+		const SlotTable* table = shard.table.load(std::memory_order_acquire);
+
+		if (!table)
+		{
+			return 0;
+		}
+
+		for (size_t position = getHome(table, hash); ; position = (position + 1) & table->mask)
+		{
+			P slot = table->slots[position].load(std::memory_order_acquire);
+
+			if (!slot)
+			{
+				return 0;
+			}
+
+			if (getChunk(slot - 1).values[(slot - 1) & (chunkSize - 1)] == value)
+			{
+				return getPrimeAt(slot - 1);
+			}
+		}
+	}
+
+	P getPrimeAt(size_t index) const
+	{
+		return source->getCalculatedPrimes()[index];
+	}
+
+	/**
+		Returns the chunk of a published index.
+	*/
+	const Chunk& getChunk(size_t index) const
+	{
+		return *chunks[index >> chunkShift].load(std::memory_order_acquire);
+	}
+
+	/**
+		Returns the chunk of an index, allocating it if no thread has yet. Two threads
+		may allocate the same chunk at once, and the one that loses deletes its own.
+	*/
+	Chunk& allocateChunk(size_t index)
+	{
+		std::atomic<Chunk*>& slot = chunks[index >> chunkShift];
+		Chunk* chunk = slot.load(std::memory_order_acquire);
+
+		if (!chunk)
+		{
+			std::unique_ptr<Chunk> allocated(new Chunk());
+
+			if (slot.compare_exchange_strong(chunk, allocated.get()))
+			{
+				chunk = allocated.release();
+			}
+		}
+
+		return *chunk;
+	}
+
+	/**
+		Replaces the table of a shard with one twice its size, or creates its first
+		one, and returns it. The shard must be locked.
+	*/
+	SlotTable* grow(Shard& shard)
+	{
+		SlotTable* table = shard.table.load(std::memory_order_relaxed);
+		std::unique_ptr<SlotTable> grown(new SlotTable(table ? 2 * (table->mask + 1) : 16));
+
+		if (table)
+		{
+			for (size_t position = 0; position <= table->mask; position++)
+			{
+				P slot = table->slots[position].load(std::memory_order_relaxed);
+
+				if (slot)
+				{
+					const V& value = getChunk(slot - 1).values[(slot - 1) & (chunkSize - 1)];
+					size_t target = getHome(grown.get(), hashValue(value));
+
+					while (grown->slots[target].load(std::memory_order_relaxed))
+					{
+						target = (target + 1) & grown->mask;
+					}
+
+					grown->slots[target].store(slot, std::memory_order_relaxed);
+				}
+			}
+		}
+
+		shard.table.store(grown.get(), std::memory_order_release);
+		shard.tables.push_back(std::move(grown));
+
+		return shard.tables.back().get();
+	}
+
+	/**
+		The source of the primes.
+	*/
+	std::shared_ptr<PrimeSource<P, Store>> source;
+
+	std::unique_ptr<Shard[]> shards;
+	size_t numShards;
+
+	/**
+		The directory of value chunks. A chunk is allocated by the first value that
+		falls into it.
+	*/
+	std::unique_ptr<std::atomic<Chunk*>[]> chunks;
+
+	/**
+		The index of the next prime to hand out. Every index below it has either been
+		handed out or is being handed out.
+	*/
+	std::atomic<size_t> nextIndex;
+
+	std::atomic<size_t> numValues;
+};
@@ -0,0 +1,597 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FLAT_HASH_MAP_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/**
+	A FlatHashMap is an open addressing hash map in the style of a Swiss table. The
+	elements are stored inline in one array of slots, next to an array with one
+	control byte per slot. A control byte is either empty, deleted, or the low 7 bits
+	of the hash of the key in the slot.
+
+	The slots are split into groups of 16. A lookup hashes the key once, picks a
+	group from the upper bits of the hash and compares the low 7 bits against all 16
+	control bytes of the group at once, with SSE2 where it is available. Keys are
+	only compared for the few slots whose control byte matches. Probing moves on to
+	further groups only while a group is full, so almost every lookup touches a
+	single cache line of control bytes and the slot it finds.
+
+	Inserting never allocates except when the table grows, which happens when it is
+	7/8 full. Growing moves every element, so references and iterators into the map
+	are invalidated by any insertion. The key of an element must not be modified
+	through an iterator.
+*/
+template <typename K, typename T, typename Hash = std::hash<K>, typename KeyEqual = std::equal_to<K>>
+class FlatHashMap
+{
+public:
+	typedef K key_type;
+	typedef T mapped_type;
+	typedef std::pair<K, T> value_type;
+
+	/**
+		The number of slots in a group, which is the number of control bytes that
+		are matched at once.
+	*/
+	static const size_t groupSize = 16;
+
+	/**
+		This is an iterator over the elements of a map, in slot order.
+	*/
+	template <typename Value>
+	class basic_iterator
+	{
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef Value value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef Value* pointer;
+		typedef Value& reference;
+
+		basic_iterator(const FlatHashMap* map = nullptr, size_t slot = 0) : map(map), slot(slot)
+		{
+			skipEmpty();
+		}
+
+		/**
+			Converts an iterator to a const_iterator.
+		*/
+		template <typename Other>
+		basic_iterator(const basic_iterator<Other>& other) : map(other.map), slot(other.slot)
+		{
+		}
+
+		Value& operator*() const
+		{
+			return map->slots[slot];
+		}
+
+		Value* operator->() const
+		{
+			return &map->slots[slot];
+		}
+
+		basic_iterator& operator++()
+		{
+			slot++;
+			skipEmpty();
+			return *this;
+		}
+
+		basic_iterator operator++(int)
+		{
+			basic_iterator copy = *this;
+			++*this;
+			return copy;
+		}
+
+		template <typename Other>
+		bool operator==(const basic_iterator<Other>& other) const
+		{
+			return slot == other.slot;
+		}
+
+		template <typename Other>
+		bool operator!=(const basic_iterator<Other>& other) const
+		{
+			return slot != other.slot;
+		}
+
+	private:
+		template <typename Other>
+		friend class basic_iterator;
+
+		void skipEmpty()
+		{
+			while (map && slot < map->capacity && map->control[slot] < 0)
+			{
+				slot++;
+			}
+		}
+
+		const FlatHashMap* map;
+		size_t slot;
+	};
+
+	typedef basic_iterator<value_type> iterator;
+	typedef basic_iterator<const value_type> const_iterator;
+
+	/**
+		This constructor creates an empty map. The hash function and key comparison
+		can carry state, for example a pointer to where the keys are really stored.
+	*/
+	FlatHashMap(const Hash& hasher = Hash(), const KeyEqual& equal = KeyEqual())
+		: control(nullptr), slots(nullptr), capacity(0), numElements(0), growthLeft(0), hasher(hasher), equal(equal)
+	{
+	}
+
+	FlatHashMap(const FlatHashMap&) = delete;
+	FlatHashMap& operator=(const FlatHashMap&) = delete;
+
+	~FlatHashMap()
+	{
+		destroy();
+	}
+
+	iterator begin()
+	{
+		return iterator(this, 0);
+	}
+
+	iterator end()
+	{
+		return iterator(this, capacity);
+	}
+
+	const_iterator begin() const
+	{
+		return const_iterator(this, 0);
+	}
+
+	const_iterator end() const
+	{
+		return const_iterator(this, capacity);
+	}
+
+	size_t size() const
+	{
+		return numElements;
+	}
+
+	bool empty() const
+	{
+		return !numElements;
+	}
+
+	/**
+		Returns the number of slots, which is the number of elements the map could
+		hold if it never grew.
+	*/
+	size_t bucket_count() const
+	{
+		return capacity;
+	}
+
+	/**
+		Returns an iterator to the element with the given key, or end() if there is
+		none.
+	*/
+	iterator find(const K& key)
+	{
+		return iterator(this, findSlot(key));
+	}
+
+	const_iterator find(const K& key) const
+	{
+		return const_iterator(this, findSlot(key));
+	}
+
+	/**
+		Finds the element whose key compares equal to a key of another type. This is
+		only available if Hash and KeyEqual declare is_transparent, and they have to
+		hash and compare both types consistently.
+	*/
+	template <typename Key, typename H = Hash, typename = typename H::is_transparent>
+	iterator find(const Key& key)
+	{
+		return iterator(this, findSlot(key));
+	}
+
+	template <typename Key, typename H = Hash, typename = typename H::is_transparent>
+	const_iterator find(const Key& key) const
+	{
+		return const_iterator(this, findSlot(key));
+	}
+
+	size_t count(const K& key) const
+	{
+		return findSlot(key) != capacity;
+	}
+
+	/**
+		Returns the value of the element with the given key. Throws std::out_of_range
+		if there is none.
+	*/
+	T& at(const K& key)
+	{
+		size_t slot = findSlot(key);
+
+		if (slot == capacity)
+		{
+			throw std::out_of_range("The key is not contained in the map.");
+		}
+
+		return slots[slot].second;
+	}
+
+	const T& at(const K& key) const
+	{
+		return const_cast<FlatHashMap*>(this)->at(key);
+	}
+
+	/**
+		Returns the value of the element with the given key, inserting a default value
+		if there is none.
+	*/
+	T& operator[](const K& key)
+	{
+		return emplace(key, T()).first->second;
+	}
+
+	/**
+		Inserts an element unless one with the same key exists. Returns an iterator to
+		the element with the key and whether it was inserted.
+	*/
+	std::pair<iterator, bool> emplace(const K& key, T value)
+	{
+		uint64_t hash = hashKey(key);
+		size_t slot = findSlot(key, hash);
+
+		if (slot != capacity)
+		{
+			return std::make_pair(iterator(this, slot), false);
+		}
+
+		if (!growthLeft)
+		{
+			rehash(numElements + 1);
+		}
+
+		slot = findInsertSlot(hash);
+
+		/*
+			A deleted slot is reused without using up any of the growth left.
+		*/
+		if (control[slot] == emptyControl)
+		{
+			growthLeft--;
+		}
+
+		new (&slots[slot]) value_type(key, std::move(value));
+		control[slot] = int8_t(hash & 0x7F);
+		numElements++;
+
+		return std::make_pair(iterator(this, slot), true);
+	}
+
+	/**
+		Removes the element with the given key. Returns the number of elements removed.
+	*/
+	size_t erase(const K& key)
+	{
+		size_t slot = findSlot(key);
+
+		if (slot == capacity)
+		{
+			return 0;
+		}
+
+		slots[slot].~value_type();
+		numElements--;
+
+		/*
+			A group that still has an empty slot never made a probe move past it, so the
+			slot can become empty again. Otherwise it has to stay marked as deleted.
+		*/
+		size_t group = slot & ~(groupSize - 1);
+
+		if (matchByte(control + group, emptyControl))
+		{
+			control[slot] = emptyControl;
+			growthLeft++;
+		}
+		else
+		{
+			control[slot] = deletedControl;
+		}
+
+		return 1;
+	}
+
+	/**
+		Removes every element. The memory of the table is kept.
+	*/
+	void clear()
+	{
+		for (size_t slot = 0; slot < capacity; slot++)
+		{
+			if (control[slot] >= 0)
+			{
+				slots[slot].~value_type();
+			}
+
+			control[slot] = emptyControl;
+		}
+
+		numElements = 0;
+		growthLeft = maxLoad(capacity);
+	}
+
+	/**
+		Makes room for at least numElements elements without growing.
+	*/
+	void reserve(size_t numElements)
+	{
+		if (numElements > this->numElements + growthLeft)
+		{
+			rehash(numElements);
+		}
+	}
+
+private:
+	static const int8_t emptyControl = -128;
+	static const int8_t deletedControl = -2;
+
+	/**
+		Returns the number of elements a table with the given capacity holds before it
+		grows.
+	*/
+	static size_t maxLoad(size_t capacity)
+	{
+		return capacity - capacity / 8;
+	}
+
+	/**
+		Mixes the bits of the hash of a key. Standard library hashes of integers are
+		often the identity, which would leave the low 7 bits that go into the control
+		bytes badly distributed.
+	*/
+	template <typename Key>
+	uint64_t hashKey(const Key& key) const
+	{
+		uint64_t hash = uint64_t(hasher(key));
+
+		hash ^= hash >> 33;
+		hash *= 0xFF51AFD7ED558CCDull;
+		hash ^= hash >> 33;
+
+		return hash;
+	}
+
+	/**
+		Returns a bit mask with bit i set if control byte i of the group equals byte.
+	*/
+	static uint32_t matchByte(const int8_t* group, int8_t byte)
+	{
+#ifdef FLAT_HASH_MAP_SSE2
+		__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+		return uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(byte))));
+#else
+		uint32_t mask = 0;
+
+		for (uint32_t index = 0; index < groupSize; index++)
+		{
+			mask |= uint32_t(group[index] == byte) << index;
+		}
+
+		return mask;
+#endif
+	}
+
+	/**
+		Returns a bit mask with bit i set if slot i of the group is empty or deleted.
+	*/
+	static uint32_t matchFree(const int8_t* group)
+	{
+#ifdef FLAT_HASH_MAP_SSE2
+		return uint32_t(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(group))));
+#else
+		uint32_t mask = 0;
+
+		for (uint32_t index = 0; index < groupSize; index++)
+		{
+			mask |= uint32_t(group[index] < 0) << index;
+		}
+
+		return mask;
+#endif
+	}
+
+	/**
+		Returns the index of the lowest set bit of a non-zero mask.
+	*/
+	static uint32_t lowestBit(uint32_t mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return uint32_t(index);
+#else
+		return uint32_t(__builtin_ctz(mask));
+#endif
+	}
+
+	template <typename Key>
+	size_t findSlot(const Key& key) const
+	{
+		return findSlot(key, hashKey(key));
+	}
+
+	/**
+		Returns the slot of the element with the given key, or capacity if there is
+		none. The groups are probed in triangular order, which visits every group of
+		a power of two sized table.
+	*/
+	template <typename Key>
+	size_t findSlot(const Key& key, uint64_t hash) const
+	{
+		if (!capacity)
+		{
+			return capacity;
+		}
+
+		size_t groupMask = capacity / groupSize - 1;
+		size_t group = size_t(hash >> 7) & groupMask;
+
+		for (size_t step = 1; ; step++)
+		{
+			const int8_t* groupControl = control + group * groupSize;
+
+			for (uint32_t match = matchByte(groupControl, int8_t(hash & 0x7F)); match; match &= match - 1)
+			{
+				size_t slot = group * groupSize + lowestBit(match);
+
+				if (equal(slots[slot].first, key))
+				{
+					return slot;
+				}
+			}
+
+			if (matchByte(groupControl, emptyControl) || step > groupMask)
+			{
+				return capacity;
+			}
+
+			group = (group + step) & groupMask;
+		}
+	}
+
+	/**
+		Returns the first empty or deleted slot on the probe sequence of a hash. The
+		table must have room for another element.
+	*/
+	size_t findInsertSlot(uint64_t hash) const
+	{
+		size_t groupMask = capacity / groupSize - 1;
+		size_t group = size_t(hash >> 7) & groupMask;
+
+		for (size_t step = 1; ; step++)
+		{
+			uint32_t match = matchFree(control + group * groupSize);
+
+			if (match)
+			{
+				return group * groupSize + lowestBit(match);
+			}
+
+			group = (group + step) & groupMask;
+		}
+	}
+
+	/**
+		Moves every element into a new table that holds at least numElements elements
+		before it has to grow again. Deleted slots are dropped on the way.
+	*/
+	void rehash(size_t numElements)
+	{
+		size_t newCapacity = groupSize;
+
+		while (maxLoad(newCapacity) < numElements || newCapacity < 2 * this->numElements)
+		{
+			newCapacity *= 2;
+		}
+
+		int8_t* oldControl = control;
+		value_type* oldSlots = slots;
+		size_t oldCapacity = capacity;
+
+		control = new int8_t[newCapacity];
+		slots = allocator.allocate(newCapacity);
+		capacity = newCapacity;
+
+		for (size_t slot = 0; slot < capacity; slot++)
+		{
+			control[slot] = emptyControl;
+		}
+
+		for (size_t slot = 0; slot < oldCapacity; slot++)
+		{
+			if (oldControl[slot] >= 0)
+			{
+				size_t newSlot = findInsertSlot(hashKey(oldSlots[slot].first));
+
+				new (&slots[newSlot]) value_type(std::move(oldSlots[slot]));
+				control[newSlot] = oldControl[slot];
+				oldSlots[slot].~value_type();
+			}
+		}
+
+		growthLeft = maxLoad(capacity) - this->numElements;
+
+		delete[] oldControl;
+
+		if (oldSlots)
+		{
+			allocator.deallocate(oldSlots, oldCapacity);
+		}
+	}
+
+	void destroy()
+	{
+		for (size_t slot = 0; slot < capacity; slot++)
+		{
+			if (control[slot] >= 0)
+			{
+				slots[slot].~value_type();
+			}
+		}
+
+		delete[] control;
+
+		if (slots)
+		{
+			allocator.deallocate(slots, capacity);
+		}
+	}
+
+	/**
+		The control bytes, one for each slot.
+	*/
+	int8_t* control;
+
+	/**
+		The slots. Only those with a control byte of 0 to 127 hold an element.
+	*/
+	value_type* slots;
+
+	/**
+		The number of slots, a power of two and a multiple of groupSize, or 0 before
+		the first insertion.
+	*/
+	size_t capacity;
+
+	size_t numElements;
+
+	/**
+		The number of empty slots that can still be filled before the table grows.
+	*/
+	size_t growthLeft;
+
+	Hash hasher;
+	KeyEqual equal;
+	std::allocator<value_type> allocator;
+};
@@ -0,0 +1,120 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : view(nullptr), viewSize(0)
+#ifdef _WIN32
+	, fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+	if (view)
+	{
+		UnmapViewOfFile(view);
+	}
+
+	if (mappingHandle)
+	{
+		CloseHandle(mappingHandle);
+	}
+
+	if (fileHandle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(fileHandle);
+	}
+#else
+	if (view)
+	{
+		munmap(const_cast<void*>(view), viewSize);
+	}
+#endif
+}
+
+std::shared_ptr<const MappedFile> MappedFile::open(const std::string& path)
+{
+	std::shared_ptr<MappedFile> file(new MappedFile());
+
+#ifdef _WIN32
+	file->fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	LARGE_INTEGER size;
+
+	if (file->fileHandle == INVALID_HANDLE_VALUE || !GetFileSizeEx(file->fileHandle, &size))
+	{
+		throw std::runtime_error("Could not open file " + path);
+	}
+
+	file->viewSize = size_t(size.QuadPart);
+
+	if (file->viewSize)
+	{
+		file->mappingHandle = CreateFileMappingA(file->fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+		if (file->mappingHandle)
+		{
+			file->view = MapViewOfFile(file->mappingHandle, FILE_MAP_READ, 0, 0, 0);
+		}
+	}
+#else
+	int descriptor = ::open(path.c_str(), O_RDONLY);
+	struct stat status;
+
+	if (descriptor < 0 || fstat(descriptor, &status) != 0)
+	{
+		if (descriptor >= 0)
+		{
+			close(descriptor);
+		}
+
+		throw std::runtime_error("Could not open file " + path);
+	}
+
+	file->viewSize = size_t(status.st_size);
+
+	if (file->viewSize)
+	{
+		void* view = mmap(nullptr, file->viewSize, PROT_READ, MAP_SHARED, descriptor, 0);
+
+		if (view != MAP_FAILED)
+		{
+			file->view = view;
+		}
+	}
+
+	/*
+		The mapping stays valid after the descriptor is closed.
+	*/
+	close(descriptor);
+#endif
+
+	if (!file->view)
+	{
+		throw std::runtime_error("Could not map file " + path);
+	}
+
+	return file;
+}
+
+const void* MappedFile::getData() const
+{
+	return view;
+}
+
+size_t MappedFile::getSize() const
+{
+	return viewSize;
+}
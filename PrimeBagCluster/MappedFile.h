@@ -0,0 +1,52 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <cstddef>
+
+/**
+	A MappedFile is a read-only memory mapping of a whole file. Every process that
+	maps the same file shares one copy of it in the page cache, and pages are only
+	read from disk when they are first touched.
+*/
+class MappedFile
+{
+public:
+	/**
+		Maps a file into memory. Throws std::runtime_error if the file cannot be
+		opened or mapped, which includes empty files.
+	*/
+	static std::shared_ptr<const MappedFile> open(const std::string& path);
+
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/**
+		Returns the start of the mapped file.
+	*/
+	const void* getData() const;
+
+	/**
+		Returns the size of the file in bytes.
+	*/
+	size_t getSize() const;
+
+private:
+	MappedFile();
+
+	/**
+		The mapped view of the whole file.
+	*/
+	const void* view;
+	size_t viewSize;
+
+#ifdef _WIN32
+	/**
+		The handles that keep the mapping open on Windows.
+	*/
+	void* fileHandle;
+	void* mappingHandle;
+#endif
+};
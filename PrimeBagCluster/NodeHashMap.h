@@ -0,0 +1,272 @@
+#pragma once
+
+#include <functional>
+#include <iterator>
+#include <unordered_map>
+#include <utility>
+#include <cstddef>
+
+/**
+	A NodeHashMap is a hash map with the interface of a FlatHashMap on top of a
+	std::unordered_multimap, so every element lives in its own node. The standard
+	unordered containers only support lookups with a key of another type from
+	C++20 on, so the nodes are keyed by the hash of their key, and a lookup hashes
+	its key once and compares it against the few nodes with the same hash.
+
+	Unlike a FlatHashMap, references to elements stay valid when the map grows, at
+	the cost of one allocation per insert and a pointer chase per lookup. The key of
+	an element must not be modified through an iterator.
+*/
+template <typename K, typename T, typename Hash = std::hash<K>, typename KeyEqual = std::equal_to<K>>
+class NodeHashMap
+{
+	/**
+		The nodes are hashed by the hash of their key, which is already computed.
+	*/
+	struct IdentityHash
+	{
+		size_t operator()(size_t hash) const
+		{
+			return hash;
+		}
+	};
+
+public:
+	typedef K key_type;
+	typedef T mapped_type;
+	typedef std::pair<K, T> value_type;
+
+private:
+	typedef std::unordered_multimap<size_t, value_type, IdentityHash> node_map;
+
+public:
+	/**
+		This is an iterator over the elements of a map, in the order of the nodes.
+	*/
+	template <typename Value, typename NodeIterator>
+	class basic_iterator
+	{
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef Value value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef Value* pointer;
+		typedef Value& reference;
+
+		basic_iterator() = default;
+
+		basic_iterator(NodeIterator node) : node(node)
+		{
+		}
+
+		template <typename OtherValue, typename OtherNodeIterator>
+		basic_iterator(const basic_iterator<OtherValue, OtherNodeIterator>& other) : node(other.node)
+		{
+		}
+
+		Value& operator*() const
+		{
+			return node->second;
+		}
+
+		Value* operator->() const
+		{
+			return &node->second;
+		}
+
+		basic_iterator& operator++()
+		{
+			++node;
+			return *this;
+		}
+
+		basic_iterator operator++(int)
+		{
+			basic_iterator copy = *this;
+			++*this;
+			return copy;
+		}
+
+		template <typename OtherValue, typename OtherNodeIterator>
+		bool operator==(const basic_iterator<OtherValue, OtherNodeIterator>& other) const
+		{
+			return node == other.node;
+		}
+
+		template <typename OtherValue, typename OtherNodeIterator>
+		bool operator!=(const basic_iterator<OtherValue, OtherNodeIterator>& other) const
+		{
+			return node != other.node;
+		}
+
+	private:
+		template <typename OtherValue, typename OtherNodeIterator>
+		friend class basic_iterator;
+
+		NodeIterator node;
+	};
+
+	typedef basic_iterator<value_type, typename node_map::iterator> iterator;
+	typedef basic_iterator<const value_type, typename node_map::const_iterator> const_iterator;
+
+	/**
+		This constructor creates an empty map. The hash function and key comparison
+		can carry state, for example a pointer to where the keys are really stored.
+	*/
+	NodeHashMap(const Hash& hasher = Hash(), const KeyEqual& equal = KeyEqual())
+		: hasher(hasher), equal(equal)
+	{
+	}
+
+	NodeHashMap(const NodeHashMap&) = delete;
+	NodeHashMap& operator=(const NodeHashMap&) = delete;
+
+	iterator begin()
+	{
+		return iterator(nodes.begin());
+	}
+
+	iterator end()
+	{
+		return iterator(nodes.end());
+	}
+
+	const_iterator begin() const
+	{
+		return const_iterator(nodes.begin());
+	}
+
+	const_iterator end() const
+	{
+		return const_iterator(nodes.end());
+	}
+
+	size_t size() const
+	{
+		return nodes.size();
+	}
+
+	bool empty() const
+	{
+		return nodes.empty();
+	}
+
+	size_t bucket_count() const
+	{
+		return nodes.bucket_count();
+	}
+
+	/**
+		Returns an iterator to the element with the given key, or end() if there is
+		none.
+	*/
+	iterator find(const K& key)
+	{
+		return iterator(findNode(key));
+	}
+
+	const_iterator find(const K& key) const
+	{
+		return const_iterator(const_cast<NodeHashMap*>(this)->findNode(key));
+	}
+
+	/**
+		Finds the element whose key compares equal to a key of another type. This is
+		only available if Hash and KeyEqual declare is_transparent, and they have to
+		hash and compare both types consistently.
+	*/
+	template <typename Key, typename H = Hash, typename = typename H::is_transparent>
+	iterator find(const Key& key)
+	{
+		return iterator(findNode(key));
+	}
+
+	template <typename Key, typename H = Hash, typename = typename H::is_transparent>
+	const_iterator find(const Key& key) const
+	{
+		return const_iterator(const_cast<NodeHashMap*>(this)->findNode(key));
+	}
+
+	size_t count(const K& key) const
+	{
+		return find(key) != end();
+	}
+
+	/**
+		Inserts an element unless one with the same key exists. Returns an iterator to
+		the element with the key and whether it was inserted.
+	*/
+	std::pair<iterator, bool> emplace(const K& key, T value)
+	{
+		size_t hash = hasher(key);
+		auto node = findNode(key, hash);
+
+		if (node != nodes.end())
+		{
+			return std::make_pair(iterator(node), false);
+		}
+
+		node = nodes.emplace(hash, value_type(key, std::move(value)));
+		return std::make_pair(iterator(node), true);
+	}
+
+	/**
+		Removes the element with the given key. Returns the number of elements removed.
+	*/
+	size_t erase(const K& key)
+	{
+		auto node = findNode(key);
+
+		if (node == nodes.end())
+		{
+			return 0;
+		}
+
+		nodes.erase(node);
+		return 1;
+	}
+
+	void clear()
+	{
+		nodes.clear();
+	}
+
+	/**
+		Makes room for at least numElements elements without rehashing.
+	*/
+	void reserve(size_t numElements)
+	{
+		nodes.reserve(numElements);
+	}
+
+private:
+	template <typename Key>
+	typename node_map::iterator findNode(const Key& key)
+	{
+		return findNode(key, hasher(key));
+	}
+
+	/**
+		Returns the node with the given key among the nodes with its hash, or the end
+		of the nodes.
+	*/
+	template <typename Key>
+	typename node_map::iterator findNode(const Key& key, size_t hash)
+	{
+		auto range = nodes.equal_range(hash);
+
+		for (auto node = range.first; node != range.second; ++node)
+		{
+			if (equal(node->second.first, key))
+			{
+				return node;
+			}
+		}
+
+		return nodes.end();
+	}
+
+	node_map nodes;
+	Hash hasher;
+	KeyEqual equal;
+};
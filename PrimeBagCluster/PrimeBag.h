@@ -1,6 +1,12 @@
 #pragma once
 
 #include "PrimeTable.h"
+#include "PrimeRemapping.h"
+#include "WordDivisor.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <vector>
 #include <boost/multiprecision/cpp_int.hpp>
 
 typedef boost::multiprecision::cpp_int bignum;
@@ -8,30 +14,247 @@ typedef unsigned long long ulong;
 typedef unsigned int uint;
 
 /**
-	This helper function determines whether a given number is divisible 
-	by another number. Used for determining whether one bag contains 
-	another bag.
+	A smallnum holds the product of a small bag inline, so that the bag does not
+	allocate and its arithmetic is native. It is 128 bits wide where the compiler
+	has a 128-bit integer type. MSVC has none, so there a smallnum is only 64 bits
+	and a bag moves its product to a bignum after about half as many values.
 */
-static bool containsHash(const bignum& hash, const bignum& otherHash)
+#ifdef __SIZEOF_INT128__
+typedef unsigned __int128 smallnum;
+
+static bignum toBignum(smallnum number)
 {
-	return !(hash % otherHash);
-};
+	return (bignum(ulong(number >> 64)) << 64) | bignum(ulong(number));
+}
+
+static smallnum toSmallnum(const bignum& number)
+{
+	return (smallnum((number >> 64).convert_to<ulong>()) << 64) | (number & bignum(~0ull)).convert_to<ulong>();
+}
+#else
+typedef unsigned long long smallnum;
+
+static bignum toBignum(smallnum number)
+{
+	return bignum(number);
+}
+
+static smallnum toSmallnum(const bignum& number)
+{
+	return number.convert_to<ulong>();
+}
+#endif
+
+static const uint smallnumBits = uint(8 * sizeof(smallnum));
 
 /**
 	This is an iterator 
 */
-template<typename V>
+template<typename V, typename P = uint32_t, typename Table = PrimeTable<V, P>>
 class PrimeBagIterator;
 
-template <typename V>
-class PrimeBag
+/**
+	A PrimeBag is a multiset of values. Each value is mapped to a prime number by a
+	shared PrimeTable, and the bag is stored as the product of those primes. The type
+	parameter P is the prime word type of the table, and Table is the type of the table,
+	which can be a PrimeTable with a different prime store.
+
+	A bag is stored in one of two forms, which it switches between by itself. Small
+	bags are the product of their primes, which is compact, but finding a value in
+	it is a division that gets slower as the bag grows. Once the product has more
+	than maxProductBits bits or the bag holds more than maxProductLength values,
+	the bag is stored as a sorted vector of its distinct primes and their
+	multiplicities instead, where finding a value is a binary search. It goes back to
+	the product once it has shrunk below half of both thresholds. The primes of a bag
+	in product form are found by trial division with the primes of its table.
+
+	Most bags are small enough that their product fits in a smallnum, where it is
+	kept inline with native arithmetic. The product only moves to a bignum once it
+	overflows, and back once it fits again.
+
+	Every bag is registered with its table from construction to destruction. It is
+	re-encoded whenever the table moves values to other primes, and holds a 
+	reference to each value it contains, so the table keeps the values until the bag
+	releases them. A copy of a bag holds references of its own, and a moved bag 
+	hands its references over. The table must outlive its bags.
+*/
+template <typename V, typename P = uint32_t, typename Table = PrimeTable<V, P>>
+class PrimeBag : public PrimeRemapListener<P>
 {
-	typedef PrimeBagIterator<V> iterator;
-	friend class iterator;
+	typedef PrimeBagIterator<V, P, Table> iterator;
+	friend class PrimeBagIterator<V, P, Table>;
 
 public:
-	PrimeBag(PrimeTable<V>* table) : globalTable(table)
+	/**
+		The default thresholds at which a bag leaves the product form.
+	*/
+	static const size_t defaultMaxProductBits = 4096;
+	static const uint defaultMaxProductLength = 256;
+
+	PrimeBag(Table* table) : globalTable(table)
+	{
+		registerWithTable();
+	}
+
+	PrimeBag(const PrimeBag<V, P, Table>& bag) : PrimeRemapListener<P>(), globalTable(bag.globalTable), hash(bag.hash), length(bag.length),
+		inlineHash(bag.inlineHash), inlined(bag.inlined), factors(bag.factors), sparse(bag.sparse), maxProductBits(bag.maxProductBits), maxProductLength(bag.maxProductLength)
+	{
+		registerWithTable();
+	}
+
+	/**
+		This constructor takes over the values and references of a bag, which is left
+		empty.
+	*/
+	PrimeBag(PrimeBag<V, P, Table>&& bag) : globalTable(bag.globalTable), hash(std::move(bag.hash)), length(bag.length),
+		inlineHash(bag.inlineHash), inlined(bag.inlined), factors(std::move(bag.factors)), sparse(bag.sparse), maxProductBits(bag.maxProductBits), maxProductLength(bag.maxProductLength)
+	{
+		takeOver(bag);
+	}
+
+	PrimeBag<V, P, Table>& operator=(const PrimeBag<V, P, Table>& bag)
+	{
+		if (this != &bag)
+		{
+			unregister();
+
+			globalTable = bag.globalTable;
+			hash = bag.hash;
+			length = bag.length;
+			inlineHash = bag.inlineHash;
+			inlined = bag.inlined;
+			factors = bag.factors;
+			sparse = bag.sparse;
+			maxProductBits = bag.maxProductBits;
+			maxProductLength = bag.maxProductLength;
+
+			registerWithTable();
+		}
+
+		return *this;
+	}
+
+	PrimeBag<V, P, Table>& operator=(PrimeBag<V, P, Table>&& bag)
+	{
+		if (this != &bag)
+		{
+			unregister();
+
+			globalTable = bag.globalTable;
+			hash = std::move(bag.hash);
+			length = bag.length;
+			inlineHash = bag.inlineHash;
+			inlined = bag.inlined;
+			factors = std::move(bag.factors);
+			sparse = bag.sparse;
+			maxProductBits = bag.maxProductBits;
+			maxProductLength = bag.maxProductLength;
+
+			takeOver(bag);
+		}
+
+		return *this;
+	}
+
+	~PrimeBag()
+	{
+		unregister();
+	}
+
+	/**
+		This is a distinct prime of a bag, together with its index in the table's
+		prime store and the number of times the bag contains it.
+	*/
+	struct PrimeFactor
+	{
+		P prime;
+		size_t index;
+		uint multiplicity;
+	};
+
+	/**
+		Sets the size in bits of the product and the number of values above which the
+		bag is stored as a vector of primes, and converts the bag if it has to.
+	*/
+	void setFormThresholds(size_t maxProductBits, uint maxProductLength)
+	{
+		this->maxProductBits = maxProductBits;
+		this->maxProductLength = maxProductLength;
+
+		updateForm();
+	}
+
+	/**
+		Returns whether the bag is stored as a vector of primes rather than as their
+		product.
+	*/
+	bool isSparse() const
+	{
+		return sparse;
+	}
+
+	/**
+		Returns the number of factors the bag has room for. A bag in product form has
+		no factor list, so this is 0 unless the bag is sparse.
+	*/
+	size_t getFactorCapacity() const
 	{
+		return factors.capacity();
+	}
+
+	/**
+		Returns the product of the primes of the bag. This is calculated if the bag is
+		stored as a vector of primes.
+	*/
+	bignum getHash() const
+	{
+		if (!sparse)
+		{
+			return inlined ? toBignum(inlineHash) : hash;
+		}
+
+		return getFactorProduct();
+	}
+
+	/**
+		Re-encodes the bag after its table moved values to other primes. Every old
+		prime the bag contains is divided out and the new primes are multiplied in
+		afterwards, since a new prime may be the old prime of another value.
+	*/
+	void remap(const PrimeRemapping<P>& remapping) override
+	{
+		if (sparse)
+		{
+			for (SparseFactor& factor : factors)
+			{
+				factor.prime = remapping.map(factor.prime);
+			}
+
+			std::sort(factors.begin(), factors.end(), [](const SparseFactor& factor, const SparseFactor& other)
+			{
+				return factor.prime < other.prime;
+			});
+
+			return;
+		}
+
+		bignum remaining = getHash();
+		bignum moved = 1;
+
+		for (const auto& entry : remapping)
+		{
+			if (remaining < entry.oldPrime)
+			{
+				break;
+			}
+
+			for (uint count = WordDivisor(entry.oldPrime).divideOut(remaining); count; count--)
+			{
+				moved *= entry.newPrime;
+			}
+		}
+
+		setHash(remaining * moved);
 	}
 
 	iterator begin() const
@@ -46,56 +269,141 @@ public:
 
 	void add(const V& value)
 	{
-		uint prime = globalTable->add(value);
+		P prime = registered ? globalTable->addReference(value) : globalTable->add(value);
 
-		hash *= prime;
+		multiply(prime, 1);
 		length++;
+
+		updateForm();
 	}
 
-	void add(const PrimeBag<V>& bag)
+	void add(const PrimeBag<V, P, Table>& bag)
 	{
 		if (bag.globalTable == globalTable)
 		{
-			bignum& otherHash = bag.hash;
+			/*
+				The bag may be this bag, so its references are counted before anything
+				changes. A sparse bag added to itself only adds to the multiplicities of
+				the factors that are visited, so none are inserted while they are.
+			*/
+			uint otherLength = bag.length;
+
+			if (registered)
+			{
+				bag.forEachFactor([this](P prime, uint multiplicity)
+				{
+					globalTable->addReferences(prime, multiplicity);
+				});
+			}
 
-			hash *= otherHash;
+			if (sparse)
+			{
+				bag.forEachFactor([this](P prime, uint multiplicity)
+				{
+					addFactor(prime, multiplicity);
+				});
+			}
+			else if (inlined && !bag.sparse && bag.inlined && inlineHash <= ~smallnum(0) / bag.inlineHash)
+			{
+				inlineHash *= bag.inlineHash;
+			}
+			else
+			{
+				setHash(getHash() * bag.getHash());
+			}
 
-			length += bag.length;
+			length += otherLength;
+			updateForm();
 		}
 	}
 
-	bool remove(const PrimeBag<V>& bag)
+	bool remove(const PrimeBag<V, P, Table>& bag)
 	{
-		if (bag.globalTable == globalTable)
+		if (bag.globalTable != globalTable || bag.length > length)
+		{
+			return false;
+		}
+
+		/*
+			A bag that is removed from itself leaves nothing.
+		*/
+		if (&bag == this)
 		{
-			if (bag.length <= length)
+			clear();
+			return true;
+		}
+
+		if (sparse)
+		{
+			bool contained = true;
+
+			bag.forEachFactor([this, &contained](P prime, uint multiplicity)
 			{
-				if (containsHash(hash, bag.hash))
-				{
-					hash /= bag.hash;
-					length -= bag.length;
+				contained &= countFactor(prime) >= multiplicity;
+			});
 
-					return true;
-				}
+			if (!contained)
+			{
+				return false;
+			}
+		}
+		else if (inlined && !bag.sparse && bag.inlined)
+		{
+			if (inlineHash % bag.inlineHash)
+			{
+				return false;
 			}
 		}
+		else if (getHash() % bag.getHash())
+		{
+			return false;
+		}
 
-		return false;
+		if (registered)
+		{
+			releaseReferences(bag);
+		}
+
+		if (sparse)
+		{
+			bag.forEachFactor([this](P prime, uint multiplicity)
+			{
+				removeFactor(prime, multiplicity);
+			});
+		}
+		else if (inlined && !bag.sparse && bag.inlined)
+		{
+			inlineHash /= bag.inlineHash;
+		}
+		else
+		{
+			setHash(getHash() / bag.getHash());
+		}
+
+		length -= bag.length;
+		updateForm();
+
+		return true;
 	}
 
-	bool remove(const V& value)
+	template <typename Key>
+	bool remove(const Key& value)
 	{
-		bignum prime = globalTable->getPrime(value);
+		WordDivisor divisor = globalTable->getDivisor(value);
 
-		if (prime)
+		if (divisor.getPrime() && containsFactor(divisor))
 		{
-			if (containsHash(hash, prime))
-			{
-				hash /= prime;
-				length--;
+			divide(divisor, 1);
+			length--;
 
-				return true;
+			if (registered)
+			{
+				globalTable->releaseReferences(P(divisor.getPrime()));
 			}
+
+			updateForm();
+
+			return true;
 		}
 
 		return false;
@@ -103,45 +411,54 @@ public:
 
 	void clear()
 	{
+		if (registered)
+		{
+			releaseReferences(*this);
+		}
+
 		hash = 1;
 		length = 0;
+		inlineHash = 1;
+		inlined = true;
+		factors = std::vector<SparseFactor>();
+		sparse = false;
 	}
 
-	const PrimeBag<V>& operator&&(const PrimeBag<V>& bag)
+	const PrimeBag<V, P, Table>& operator&&(const PrimeBag<V, P, Table>& bag)
 	{
 
 	}
 
-	PrimeBag<V>& operator+(const V& value)
+	PrimeBag<V, P, Table>& operator+(const V& value)
 	{
 		add(value);
 		return *this;
 	}
 
-	PrimeBag<V>& operator+(const PrimeBag<V>& bag)
+	PrimeBag<V, P, Table>& operator+(const PrimeBag<V, P, Table>& bag)
 	{
 		add(bag);
 		return *this;
 	}
 
-	PrimeBag<V>& operator-(const V& value)
+	PrimeBag<V, P, Table>& operator-(const V& value)
 	{
 		remove(value);
 		return *this;
 	}
 
-	PrimeBag<V>& operator-(const PrimeBag<V>& bag)
+	PrimeBag<V, P, Table>& operator-(const PrimeBag<V, P, Table>& bag)
 	{
 		remove(bag);
 		return *this;
 	}
 
-	bool contains(const V& value) const
+	template <typename Key>
+	bool contains(const Key& value) const
 	{
-		uint prime = globalTable->getPrime(value);
+		WordDivisor divisor = globalTable->getDivisor(value);
 
-		return prime && containsHash(hash, bignum(prime));
-		;
+		return divisor.getPrime() && containsFactor(divisor);
 	}
 
 	uint size() const
@@ -149,85 +466,496 @@ public:
 		return length;
 	}
 
-	uint count(const V& value) const
+	template <typename Key>
+	uint count(const Key& value) const
 	{
-		uint prime = globalTable->getPrime(value), result = 0;
+		WordDivisor divisor = globalTable->getDivisor(value);
 
-		if (prime)
+		return divisor.getPrime() ? getMultiplicity(divisor) : 0;
+	}
+
+	std::vector<V> asVector() const
+	{
+		std::vector<V> result;
+		result.reserve(length);
+
+		for (const PrimeFactor& factor : getPrimeFactors())
+		{
+			result.insert(result.end(), factor.multiplicity, globalTable->getValueAt(factor.index));
+		}
+
+		return result;
+	}
+
+	/**
+		Returns the distinct primes of the bag in increasing order. Throws
+		std::out_of_range if a prime of the bag is not assigned to a value.
+	*/
+	std::vector<PrimeFactor> getPrimeFactors() const
+	{
+		std::vector<PrimeFactor> result;
+		uint counter = 0;
+
+		forEachFactor([this, &result, &counter](P prime, uint multiplicity)
 		{
-			bignum hashCopy = hash;
+			size_t index = globalTable->getPrimeIndex(prime);
 
-			while (containsHash(hashCopy, prime))
+			if (!globalTable->containsIndex(index))
 			{
-				hashCopy /= prime;
-				result++;
+				throw std::out_of_range("The bag holds a prime that is not assigned to a value.");
 			}
+
+			result.push_back(PrimeFactor{ prime, index, multiplicity });
+			counter += multiplicity;
+		});
+
+		/*
+			Trial division only finds the primes the table still has, so a product
+			whose values are gone has fewer factors than values.
+		*/
+		if (counter != length)
+		{
+			throw std::out_of_range("The bag holds a prime that is not assigned to a value.");
 		}
 
 		return result;
 	}
 
-	std::vector<V> asVector() const
-	{
-		std::vector<V> result;
-		bignum hashCopy = hash;
-		uint counter = length;
+public:
+	Table* globalTable;
 
-		const std::vector<uint>& primes = globalTable->getPrimeNumbers();
+	/**
+		The product of the primes of the bag once it does not fit in a smallnum, and 1
+		while the product is inline or the bag is sparse.
+	*/
+	bignum hash{ 1 };
+	uint length{ 0 };
 
-		for (uint prime : primes)
+private:
+	/**
+		A distinct prime of a sparse bag and the number of times the bag contains it.
+	*/
+	struct SparseFactor
+	{
+		P prime;
+		uint multiplicity;
+	};
+
+	/**
+		Calls a function with each distinct prime of the bag and its multiplicity, in
+		increasing order, in either form. Nothing is allocated, so references can be
+		counted and released this way whenever they have to be.
+	*/
+	template <typename Function>
+	void forEachFactor(Function function) const
+	{
+		if (sparse)
 		{
-			if (counter > 0)
+			for (const SparseFactor& factor : factors)
 			{
-				const V& value = globalTable->getValue(prime);
-				bignum bigPrime = prime;
+				function(factor.prime, factor.multiplicity);
+			}
+		}
+		else if (inlined)
+		{
+			forEachFactor(inlineHash, function);
+		}
+		else
+		{
+			forEachFactor(hash, function);
+		}
+	}
+
+	/**
+		Finds the distinct primes of a product by trial division with the primes the
+		table has handed out, in increasing order. Once the square of a prime exceeds
+		what is left of the product, the rest is a single prime, which is looked up
+		instead. Primes of values that are gone from the table are not found.
+	*/
+	template <typename Number, typename Function>
+	void forEachFactor(Number product, Function function) const
+	{
+		const typename Table::store_type& primes = globalTable->getPrimeNumbers();
+		size_t numIndices = globalTable->getNumIndices();
+		auto cursor = primes.begin();
+
+		for (size_t index = 0; product > 1 && index < numIndices; index++, ++cursor)
+		{
+			P prime = *cursor;
 
-				while (containsHash(hashCopy, bigPrime))
+			if (squareExceeds(prime, product))
+			{
+				if (product <= std::numeric_limits<P>::max() && globalTable->getPrimeIndex(P(product)) < numIndices)
 				{
-					hashCopy /= bigPrime;
-					counter--;
-					result.push_back(value);
+					function(P(product), 1);
 				}
+
+				return;
 			}
-			else
+
+			uint multiplicity = WordDivisor(prime, globalTable->getInverseAt(index)).divideOut(product);
+
+			if (multiplicity)
 			{
-				break;
+				function(prime, multiplicity);
 			}
 		}
+	}
 
-		return result;
+	/**
+		Returns whether the square of a prime is larger than a number.
+	*/
+	static bool squareExceeds(P prime, smallnum number)
+	{
+		return prime > number / prime;
 	}
 
-public:
-	PrimeTable<V>* globalTable;
-	bignum hash{ 1 };
-	uint length{ 0 };
+	static bool squareExceeds(P prime, const bignum& number)
+	{
+		return bignum(prime) * prime > number;
+	}
+
+	/**
+		Returns the product of the primes of a sparse bag.
+	*/
+	bignum getFactorProduct() const
+	{
+		bignum product = 1;
+
+		for (const SparseFactor& factor : factors)
+		{
+			product *= boost::multiprecision::pow(bignum(factor.prime), factor.multiplicity);
+		}
+
+		return product;
+	}
+
+	/**
+		Returns the position of the first factor of a sparse bag whose prime is not
+		less than the given one.
+	*/
+	typename std::vector<SparseFactor>::const_iterator findFactor(P prime) const
+	{
+		return std::lower_bound(factors.begin(), factors.end(), prime, [](const SparseFactor& factor, P prime)
+		{
+			return factor.prime < prime;
+		});
+	}
+
+	/**
+		Returns whether the bag contains a prime at least once.
+	*/
+	bool containsFactor(const WordDivisor& divisor) const
+	{
+		if (sparse)
+		{
+			P prime = P(divisor.getPrime());
+			auto iter = findFactor(prime);
+
+			return iter != factors.end() && iter->prime == prime;
+		}
+
+		return inlined ? divisor.divides(inlineHash) : divisor.divides(hash);
+	}
+
+	/**
+		Returns the number of times a sparse bag contains a prime.
+	*/
+	uint countFactor(P prime) const
+	{
+		auto iter = findFactor(prime);
+
+		return iter != factors.end() && iter->prime == prime ? iter->multiplicity : 0;
+	}
+
+	/**
+		Returns the number of times the bag contains a prime.
+	*/
+	uint getMultiplicity(const WordDivisor& divisor) const
+	{
+		if (sparse)
+		{
+			return countFactor(P(divisor.getPrime()));
+		}
+
+		if (inlined)
+		{
+			smallnum product = inlineHash;
+
+			return divisor.divideOut(product);
+		}
+
+		bignum product = hash;
+
+		return divisor.divideOut(product);
+	}
+
+	/**
+		Adds a prime to the bag a number of times, without changing the length.
+	*/
+	void multiply(P prime, uint multiplicity)
+	{
+		if (sparse)
+		{
+			addFactor(prime, multiplicity);
+			return;
+		}
+
+		if (inlined)
+		{
+			for (; multiplicity && inlineHash <= ~smallnum(0) / prime; multiplicity--)
+			{
+				inlineHash *= prime;
+			}
+
+			if (!multiplicity)
+			{
+				return;
+			}
+
+			hash = toBignum(inlineHash);
+			inlined = false;
+		}
+
+		hash *= multiplicity == 1 ? bignum(prime) : boost::multiprecision::pow(bignum(prime), multiplicity);
+	}
+
+	/**
+		Removes a prime the bag contains at least multiplicity times, without changing
+		the length.
+	*/
+	void divide(const WordDivisor& divisor, uint multiplicity)
+	{
+		if (sparse)
+		{
+			removeFactor(P(divisor.getPrime()), multiplicity);
+			return;
+		}
+
+		if (inlined)
+		{
+			for (; multiplicity; multiplicity--)
+			{
+				divisor.divideExact(inlineHash);
+			}
+		}
+		else
+		{
+			for (; multiplicity; multiplicity--)
+			{
+				divisor.divideExact(hash);
+			}
+
+			/*
+				Move the product inline if it fits again.
+			*/
+			setHash(hash);
+		}
+	}
+
+	/**
+		Adds a prime to the factors of a sparse bag a number of times.
+	*/
+	void addFactor(P prime, uint multiplicity)
+	{
+		auto iter = factors.begin() + (findFactor(prime) - factors.begin());
+
+		if (iter != factors.end() && iter->prime == prime)
+		{
+			iter->multiplicity += multiplicity;
+		}
+		else
+		{
+			factors.insert(iter, SparseFactor{ prime, multiplicity });
+		}
+	}
+
+	/**
+		Removes a prime the factors of a sparse bag contain at least multiplicity
+		times.
+	*/
+	void removeFactor(P prime, uint multiplicity)
+	{
+		auto iter = factors.begin() + (findFactor(prime) - factors.begin());
+
+		iter->multiplicity -= multiplicity;
+
+		if (!iter->multiplicity)
+		{
+			factors.erase(iter);
+		}
+	}
+
+	/**
+		Sets the product of a bag in product form, inline if it fits.
+	*/
+	void setHash(const bignum& product)
+	{
+		inlined = boost::multiprecision::msb(product) < smallnumBits;
+
+		if (inlined)
+		{
+			inlineHash = toSmallnum(product);
+			hash = 1;
+		}
+		else
+		{
+			hash = product;
+		}
+	}
+
+	/**
+		Switches the bag to the form that suits its size. The factors are found when
+		the bag leaves the product form, and dropped when it goes back.
+	*/
+	void updateForm()
+	{
+		if (!sparse)
+		{
+			if (length > maxProductLength || (!inlined && boost::multiprecision::msb(hash) >= maxProductBits))
+			{
+				std::vector<SparseFactor> sparseFactors;
+
+				forEachFactor([&sparseFactors](P prime, uint multiplicity)
+				{
+					sparseFactors.push_back(SparseFactor{ prime, multiplicity });
+				});
+
+				factors = std::move(sparseFactors);
+				hash = 1;
+				inlineHash = 1;
+				inlined = true;
+				sparse = true;
+			}
+		}
+		else if (length <= maxProductLength / 2)
+		{
+			size_t bits = 0;
+
+			for (const SparseFactor& factor : factors)
+			{
+				bits += size_t(factor.multiplicity) * (boost::multiprecision::msb(bignum(factor.prime)) + 1);
+			}
+
+			if (bits <= maxProductBits / 2)
+			{
+				bignum product = getFactorProduct();
+
+				factors = std::vector<SparseFactor>();
+				sparse = false;
+				setHash(product);
+			}
+		}
+	}
+
+	/**
+		Registers the bag with its table, so that it is re-encoded when the table 
+		reranks its values, and counts a reference to each value it contains.
+	*/
+	void registerWithTable()
+	{
+		if (globalTable && !registered)
+		{
+			globalTable->addRemapListener(this);
+			registered = true;
+
+			forEachFactor([this](P prime, uint multiplicity)
+			{
+				globalTable->addReferences(prime, multiplicity);
+			});
+		}
+	}
+
+	/**
+		Unregisters the bag from its table and releases its references.
+	*/
+	void unregister()
+	{
+		if (registered)
+		{
+			releaseReferences(*this);
+
+			globalTable->removeRemapListener(this);
+			registered = false;
+		}
+	}
+
+	/**
+		Registers the bag in place of a bag it was moved from, which keeps the
+		references the moved bag held. The moved bag is left registered and empty.
+	*/
+	void takeOver(PrimeBag<V, P, Table>& bag)
+	{
+		if (bag.registered)
+		{
+			globalTable->addRemapListener(this);
+			registered = true;
+		}
+
+		bag.hash = 1;
+		bag.length = 0;
+		bag.inlineHash = 1;
+		bag.inlined = true;
+		bag.factors = std::vector<SparseFactor>();
+		bag.sparse = false;
+	}
+
+	/**
+		Releases one reference for every value in a bag. Releasing can free a value,
+		but the primes of a product are still found by trial division afterwards,
+		since freeing a value leaves its prime in the table's list. Values that are
+		gone from the table, because it was cleared, have nothing to release.
+	*/
+	void releaseReferences(const PrimeBag<V, P, Table>& bag)
+	{
+		bag.forEachFactor([this](P prime, uint multiplicity)
+		{
+			globalTable->releaseReferences(prime, multiplicity);
+		});
+	}
+
+	bool registered{ false };
+
+	/**
+		The product of the primes of the bag while it fits in a smallnum, and 1 while
+		it does not or the bag is sparse.
+	*/
+	smallnum inlineHash{ 1 };
+	bool inlined{ true };
+
+	/**
+		The distinct primes of the bag in increasing order while it is sparse. The
+		factors are keyed by the prime rather than by its index into the list of prime
+		numbers. The primes of the table increase with their index, so the order is
+		the same either way, but lookups and remappings of the table are in primes, and
+		a key by index would need the index of the prime looked up on every contains,
+		count, add and remove.
+	*/
+	std::vector<SparseFactor> factors;
+	bool sparse{ false };
+
+	size_t maxProductBits{ defaultMaxProductBits };
+	uint maxProductLength{ defaultMaxProductLength };
 };
 
-template<typename V>
+template<typename V, typename P, typename Table>
 class PrimeBagIterator
 {
 public:
 	/*
-		This constructor will initialize the iterator at a given position for a given map.
+		This constructor will initialize the iterator at the first or past the last 
+		value of a bag.
 	*/
-	PrimeBagIterator(const PrimeBag<V>& bag, bool isEnd) : primeBagCopy(bag), refPrimeBag(bag)
+	PrimeBagIterator(const PrimeBag<V, P, Table>& bag, bool isEnd) : refPrimeBag(bag), primeTable(bag.globalTable)
 	{
-		primeTable = refPrimeBag.globalTable;
-
 		if (!bag.length || isEnd)
 		{
 			end = true;
-		}
-
-		if (end)
-		{
-			primeBagCopy.clear();
-			primeIndex = uint(primeTable->getPrimeNumbers().size() - 1);
+			position = bag.length;
 		}
 		else
 		{
-			++*this;
+			loadFactors();
 		}
 	}
 
@@ -235,7 +963,7 @@ public:
 	{
 		if (!end)
 		{
-			return primeTable->getValue(getPrimeAtTableIndex());
+			return primeTable->getValueAt(getTableIndex());
 		}
 		else
 		{
@@ -243,120 +971,118 @@ public:
 		}
 	}
 
-	bool operator==(const PrimeBagIterator<V>& other) const
+	bool operator==(const PrimeBagIterator<V, P, Table>& other) const
 	{
 		if (primeTable != other.primeTable)
 		{
 			return false;
 		}
 
-		return end == other.end && 
-			primeBagCopy.length == other.primeBagCopy.length && 
-			primeBagCopy.hash == other.primeBagCopy.hash;
+		return end == other.end && position == other.position;
 	}
 
-	bool operator!=(const PrimeBagIterator<V>& other) const
+	bool operator!=(const PrimeBagIterator<V, P, Table>& other) const
 	{
 		return !operator==(other);
 	}
 
-	PrimeBagIterator<V>& operator++()
+	PrimeBagIterator<V, P, Table>& operator++()
 	{
 		if (!end)
 		{
-			if (primeBagCopy.length > 0)
-			{
-				uint prime = getNextPrimeFactor();
-				primeBagCopy.hash /= prime;
-				primeBagCopy.length--;
-			}
-			else
+			position++;
+
+			if (++occurrence == factors[factor].multiplicity)
 			{
-				end = true;
+				factor++;
+				occurrence = 0;
 			}
+
+			end = position == refPrimeBag.length;
 		}
 
 		return *this;
 	}
 
-	PrimeBagIterator<V>& operator--()
+	PrimeBagIterator<V, P, Table>& operator--()
 	{
-		uint prime = getPrimeAtTableIndex();
-
-		if (primeBagCopy.length < refPrimeBag.length - 1)
+		if (position > 0)
 		{
-			if (end)
+			/*
+				The end iterator only finds the factors once it is moved back.
+			*/
+			if (factors.empty())
 			{
-				end = false;
+				loadFactors();
+				factor = factors.size();
 			}
-			else
+
+			position--;
+			end = false;
+
+			if (occurrence == 0)
 			{
-				primeBagCopy.hash = primeBagCopy.hash * prime;
-				primeBagCopy.length++;
+				factor--;
+				occurrence = factors[factor].multiplicity;
 			}
 
-			getPreviousPrimeFactor();
+			occurrence--;
 		}
 
 		return *this;
 	}
 
-	bool operator<(const PrimeBagIterator<V>& other) const
+	bool operator<(const PrimeBagIterator<V, P, Table>& other) const
 	{
-		return other.primeBagCopy.length < primeBagCopy.length;
+		return position < other.position;
 	}
 
-	bool operator>(const PrimeBagIterator<V>& other) const
+	bool operator>(const PrimeBagIterator<V, P, Table>& other) const
 	{
-		return other.primeBagCopy.length > primeBagCopy.length;
+		return position > other.position;
 	}
 
-	bool operator>=(const PrimeBagIterator<V>& other) const
+	bool operator>=(const PrimeBagIterator<V, P, Table>& other) const
 	{
 		return operator>(other) || operator==(other);
 	}
 
-	bool operator<=(const PrimeBagIterator<V>& other) const
+	bool operator<=(const PrimeBagIterator<V, P, Table>& other) const
 	{
 		return operator<(other) || operator==(other);
 	}
 
 public:
-	uint getPrimeAtTableIndex() const
+	P getPrimeAtTableIndex() const
 	{
-		const std::vector<uint>& primes = primeTable->getPrimeNumbers();
-		return primes[primeIndex];
+		return factors[factor].prime;
 	}
 
-	uint getNextPrimeFactor()
+	/**
+		Returns the index of the current prime in the table's prime store, which is
+		also the index of its value in the table.
+	*/
+	size_t getTableIndex() const
 	{
-		uint prime = getPrimeAtTableIndex();
-
-		while (!containsHash(primeBagCopy.hash, prime))
-		{
-			primeIndex++;
-			prime = getPrimeAtTableIndex();
-		}
-
-		return prime;
+		return factors[factor].index;
 	}
 
-	uint getPreviousPrimeFactor()
-	{
-		uint prime = getPrimeAtTableIndex();
+	const PrimeBag<V, P, Table>& refPrimeBag;
+	const Table* primeTable;
 
-		while (!(containsHash(refPrimeBag.hash, primeBagCopy.hash * prime)))
-		{
-			primeIndex--;
-			prime = getPrimeAtTableIndex();
-		}
-
-		return prime;
+private:
+	void loadFactors()
+	{
+		factors = refPrimeBag.getPrimeFactors();
 	}
 
-	const PrimeBag<V>& refPrimeBag;
-	const PrimeTable<V>* primeTable;
-	PrimeBag<V> primeBagCopy;
-	uint primeIndex{ 0 };
+	/**
+		The distinct primes of the bag in increasing order. The iterator is at the
+		occurrence-th copy of the factor-th prime, and position values into the bag.
+	*/
+	std::vector<typename PrimeBag<V, P, Table>::PrimeFactor> factors;
+	size_t factor{ 0 };
+	uint occurrence{ 0 };
+	uint position{ 0 };
 	bool end{ false };
-};
\ No newline at end of file
+};
@@ -0,0 +1,197 @@
+#include "PrimeFile.h"
+#include "PrimeStore.h"
+#include "CompactPrimeStore.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+typedef unsigned long long ulong;
+
+/**
+	The magic bytes at the start of every prime file.
+*/
+static const char primeFileMagic[8] = { 'P', 'R', 'I', 'M', 'E', 'B', 'A', 'G' };
+
+PrimeFile::PrimeFile()
+{
+}
+
+std::shared_ptr<const PrimeFile> PrimeFile::open(const std::string& path, bool verifyChecksum)
+{
+	std::shared_ptr<PrimeFile> file(new PrimeFile());
+
+	file->mapping = MappedFile::open(path);
+
+	if (file->mapping->getSize() < sizeof(PrimeFileHeader))
+	{
+		throw std::runtime_error("Prime file " + path + " is truncated");
+	}
+
+	/*
+		Validate the header before anything else is read.
+	*/
+	const PrimeFileHeader& header = file->getHeader();
+
+	if (memcmp(header.magic, primeFileMagic, sizeof(primeFileMagic)) || header.version != currentVersion)
+	{
+		throw std::runtime_error("Unknown prime file format in " + path);
+	}
+
+	if (header.wordSize != sizeof(uint32_t) && header.wordSize != sizeof(uint64_t))
+	{
+		throw std::runtime_error("Prime file " + path + " has an unsupported word size");
+	}
+
+	if (header.numPrimes != (file->mapping->getSize() - sizeof(PrimeFileHeader)) / header.wordSize ||
+		file->mapping->getSize() != sizeof(PrimeFileHeader) + header.numPrimes * header.wordSize)
+	{
+		throw std::runtime_error("Prime file " + path + " is truncated");
+	}
+
+	/*
+		A sieve that has not found any primes yet saves an empty file, which has not
+		tested anything past 1.
+	*/
+	if (!header.numPrimes && header.highestTestedNum > 1)
+	{
+		throw std::runtime_error("Prime file " + path + " is corrupt");
+	}
+
+	if (verifyChecksum)
+	{
+		uint64_t sum = header.wordSize == sizeof(uint32_t) ?
+			checksum(file->getPrimes<uint32_t>(), file->getNumPrimes()) :
+			checksum(file->getPrimes<uint64_t>(), file->getNumPrimes());
+
+		if (sum != header.checksum)
+		{
+			throw std::runtime_error("Prime file " + path + " is corrupt");
+		}
+	}
+
+	return file;
+}
+
+template <typename Store>
+void PrimeFile::write(const std::string& path, const Store& primes, ulong highestTestedNum)
+{
+	typedef typename Store::value_type P;
+
+	PrimeFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, primeFileMagic, sizeof(primeFileMagic));
+
+	header.version = currentVersion;
+	header.wordSize = sizeof(P);
+	header.numPrimes = primes.size();
+	header.highestTestedNum = highestTestedNum;
+
+	/*
+		The file is written next to the path and renamed over it once it is complete,
+		so that a failed write leaves the old file as it was.
+	*/
+	std::string temporaryPath = path + ".tmp";
+	std::ofstream stream(temporaryPath, std::ios::binary | std::ios::trunc);
+
+	/*
+		The primes are streamed out in blocks while the checksum is calculated, and the
+		header is written again once the checksum is known.
+	*/
+	stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	std::vector<P> block;
+	block.reserve(65536);
+
+	uint64_t hash = checksumSeed;
+
+	for (auto iter = primes.begin(); iter != primes.end() && stream; )
+	{
+		block.clear();
+
+		for (; iter != primes.end() && block.size() < 65536; ++iter)
+		{
+			block.push_back(*iter);
+		}
+
+		hash = checksum(block.data(), block.size(), hash);
+		stream.write(reinterpret_cast<const char*>(block.data()), std::streamsize(block.size() * sizeof(P)));
+	}
+
+	header.checksum = hash;
+
+	stream.seekp(0);
+	stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	stream.flush();
+
+	bool written = bool(stream);
+	stream.close();
+
+	if (!written || stream.fail())
+	{
+		std::remove(temporaryPath.c_str());
+		throw std::runtime_error("Could not write prime file " + path);
+	}
+
+#ifdef _WIN32
+	bool renamed = MoveFileExA(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	bool renamed = std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+#endif
+
+	if (!renamed)
+	{
+		std::remove(temporaryPath.c_str());
+		throw std::runtime_error("Could not replace prime file " + path);
+	}
+}
+
+template <typename P>
+uint64_t PrimeFile::checksum(const P* primes, size_t numPrimes, uint64_t hash)
+{
+	for (size_t index = 0; index < numPrimes; index++)
+	{
+		hash ^= primes[index];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+template void PrimeFile::write(const std::string& path, const PrimeStore<uint32_t>& primes, ulong highestTestedNum);
+template void PrimeFile::write(const std::string& path, const PrimeStore<uint64_t>& primes, ulong highestTestedNum);
+template void PrimeFile::write(const std::string& path, const CompactPrimeStore<uint32_t>& primes, ulong highestTestedNum);
+template void PrimeFile::write(const std::string& path, const CompactPrimeStore<uint64_t>& primes, ulong highestTestedNum);
+template uint64_t PrimeFile::checksum<uint32_t>(const uint32_t* primes, size_t numPrimes, uint64_t hash);
+template uint64_t PrimeFile::checksum<uint64_t>(const uint64_t* primes, size_t numPrimes, uint64_t hash);
+
+const void* PrimeFile::getData() const
+{
+	return static_cast<const char*>(mapping->getData()) + sizeof(PrimeFileHeader);
+}
+
+const PrimeFileHeader& PrimeFile::getHeader() const
+{
+	return *static_cast<const PrimeFileHeader*>(mapping->getData());
+}
+
+uint32_t PrimeFile::getWordSize() const
+{
+	return getHeader().wordSize;
+}
+
+size_t PrimeFile::getNumPrimes() const
+{
+	return getHeader().numPrimes;
+}
+
+ulong PrimeFile::getHighestTestedNum() const
+{
+	return getHeader().highestTestedNum;
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "MappedFile.h"
+#include <memory>
+#include <string>
+#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+
+typedef unsigned long long ulong;
+
+/**
+	This is the header at the start of every prime file. The prime numbers follow it
+	directly as an array of native words. The header is 64 bytes long, so the array is
+	aligned for any word size.
+*/
+struct PrimeFileHeader
+{
+	/**
+		Always "PRIMEBAG".
+	*/
+	char magic[8];
+
+	/**
+		The version of the file format. Files with a different version are rejected.
+	*/
+	uint32_t version;
+
+	/**
+		The size in bytes of each stored prime, either 4 or 8.
+	*/
+	uint32_t wordSize;
+
+	/**
+		The number of stored primes.
+	*/
+	uint64_t numPrimes;
+
+	/**
+		The highest number that was tested for primality when the file was written.
+		Sieving can continue right after it.
+	*/
+	uint64_t highestTestedNum;
+
+	/**
+		A 64-bit FNV-1a hash of the prime array, taken one word at a time.
+	*/
+	uint64_t checksum;
+
+	uint64_t reserved[3];
+};
+
+/**
+	A PrimeFile is a read-only memory mapping of a file of precomputed prime numbers.
+	Every process that maps the same file shares one copy of it in the page cache, and
+	opening it costs O(1) when the checksum is not verified.
+*/
+class PrimeFile
+{
+public:
+	/**
+		The version of the file format written by this class.
+	*/
+	static const uint32_t currentVersion = 1;
+
+	/**
+		The starting value of a checksum, the 64-bit FNV offset basis.
+	*/
+	static const uint64_t checksumSeed = 14695981039346656037ull;
+
+	/**
+		Maps a prime file into memory. Throws std::runtime_error if the file cannot be
+		mapped or has an unknown format. The checksum is verified by reading the whole 
+		file unless verifyChecksum is false. A file may hold no primes, as saved by a
+		sieve that has not been used.
+	*/
+	static std::shared_ptr<const PrimeFile> open(const std::string& path, bool verifyChecksum = true);
+
+	/**
+		Writes the primes of a PrimeStore or CompactPrimeStore to a new prime file. The
+		file is written to the path with ".tmp" appended and then renamed over the 
+		path, so readers that map an existing file keep it and a failed write leaves it
+		as it was. Throws std::runtime_error if the file cannot be written or renamed.
+		On Windows, the path must not be a file that is currently mapped.
+	*/
+	template <typename Store>
+	static void write(const std::string& path, const Store& primes, ulong highestTestedNum);
+
+	/**
+		Returns the checksum of an array of primes as it is stored in the header. A 
+		checksum can be continued over several arrays by passing in the previous result.
+	*/
+	template <typename P>
+	static uint64_t checksum(const P* primes, size_t numPrimes, uint64_t hash = checksumSeed);
+
+	PrimeFile(const PrimeFile&) = delete;
+	PrimeFile& operator=(const PrimeFile&) = delete;
+
+	/**
+		Returns the mapped array of primes. Throws std::runtime_error if the file 
+		stores primes of a different word size than P.
+	*/
+	template <typename P>
+	const P* getPrimes() const
+	{
+		if (getWordSize() != sizeof(P))
+		{
+			throw std::runtime_error("The prime file stores primes of a different word size.");
+		}
+
+		return static_cast<const P*>(getData());
+	}
+
+	/**
+		Returns the size in bytes of each stored prime.
+	*/
+	uint32_t getWordSize() const;
+
+	/**
+		Returns the number of primes in the file.
+	*/
+	size_t getNumPrimes() const;
+
+	/**
+		Returns the highest number that was tested for primality when the file was
+		written.
+	*/
+	ulong getHighestTestedNum() const;
+
+private:
+	PrimeFile();
+
+	/**
+		Returns the start of the mapped prime array.
+	*/
+	const void* getData() const;
+
+	/**
+		Returns the header at the start of the file.
+	*/
+	const PrimeFileHeader& getHeader() const;
+
+	/**
+		The mapping of the whole file.
+	*/
+	std::shared_ptr<const MappedFile> mapping;
+};
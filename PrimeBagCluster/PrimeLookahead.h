@@ -0,0 +1,476 @@
+#pragma once
+
+#include "PrimeSource.h"
+#include "Statistics.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/**
+	These are the counters of a PrimeLookahead. The number of popped primes over time
+	is the insert throughput, and every stall is a pop that found the buffer empty and
+	had to wait for the producer. A producer wakeup is a refill of the buffer.
+*/
+struct PrimeLookaheadStatistics
+{
+	uint64_t numPopped;
+	uint64_t numProduced;
+	uint64_t numStalls;
+	uint64_t stallNanoseconds;
+	uint64_t numProducerWakeups;
+
+	/**
+		The distribution of the nanoseconds each stall waited.
+	*/
+	HistogramSnapshot stallTimes;
+};
+
+template <typename P, typename Store>
+class PrimeLookahead;
+
+/**
+	A PrimeLookaheadProducer is the thread that refills the buffers of every 
+	PrimeLookahead on one PrimeSource, one buffer after another. Since the source is
+	usually shared by every table of a process, so is the thread, and a process with
+	many tables does not pay for a thread per table.
+
+	The thread is started by the first refill and stopped once the last lookahead
+	on the source is gone.
+*/
+template <typename P, typename Store>
+class PrimeLookaheadProducer
+{
+	friend class PrimeLookahead<P, Store>;
+
+public:
+	PrimeLookaheadProducer()
+	{
+	}
+
+	PrimeLookaheadProducer(const PrimeLookaheadProducer&) = delete;
+	PrimeLookaheadProducer& operator=(const PrimeLookaheadProducer&) = delete;
+
+	~PrimeLookaheadProducer()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+			wake.notify_one();
+		}
+
+		if (thread.joinable())
+		{
+			thread.join();
+		}
+	}
+
+	/**
+		Returns the producer of the lookaheads on a source. It is created when it is
+		first needed and destroyed when the last lookahead using it is.
+	*/
+	static std::shared_ptr<PrimeLookaheadProducer> getShared(const PrimeSource<P, Store>& source)
+	{
+		static std::mutex registryMutex;
+		static std::unordered_map<const PrimeSource<P, Store>*, std::weak_ptr<PrimeLookaheadProducer>> registry;
+
+		std::lock_guard<std::mutex> lock(registryMutex);
+		std::shared_ptr<PrimeLookaheadProducer> producer = registry[&source].lock();
+
+		if (!producer)
+		{
+			/*
+				Forget the producers of sources that are gone.
+			*/
+			for (auto iter = registry.begin(); iter != registry.end(); )
+			{
+				iter = iter->second.expired() ? registry.erase(iter) : std::next(iter);
+			}
+
+			producer = std::make_shared<PrimeLookaheadProducer>();
+			registry[&source] = producer;
+		}
+
+		return producer;
+	}
+
+private:
+	/**
+		Queues a lookahead to be refilled, and starts the thread if it is not running.
+		The lookahead must not be queued already.
+	*/
+	void request(PrimeLookahead<P, Store>* lookahead)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (!thread.joinable())
+		{
+			thread = std::thread(&PrimeLookaheadProducer::produce, this);
+		}
+
+		queue.push_back(lookahead);
+		wake.notify_one();
+	}
+
+	/**
+		Takes a lookahead out of the queue and waits until the thread is not filling
+		it. The lookahead must have told its refill to stop.
+	*/
+	void cancel(PrimeLookahead<P, Store>* lookahead)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		queue.erase(std::remove(queue.begin(), queue.end(), lookahead), queue.end());
+		idle.wait(lock, [&]() { return filling != lookahead; });
+	}
+
+	/**
+		This is the body of the thread. It refills the queued lookaheads in turn, and
+		sleeps while none is queued.
+	*/
+	void produce()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		while (true)
+		{
+			wake.wait(lock, [&]() { return stopping || !queue.empty(); });
+
+			if (stopping)
+			{
+				return;
+			}
+
+			filling = queue.front();
+			queue.pop_front();
+
+			lock.unlock();
+			filling->fill();
+			lock.lock();
+
+			filling = nullptr;
+			idle.notify_all();
+		}
+	}
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable idle;
+
+	/**
+		The lookaheads waiting for a refill, and the one being refilled.
+	*/
+	std::deque<PrimeLookahead<P, Store>*> queue;
+	PrimeLookahead<P, Store>* filling{ nullptr };
+
+	std::thread thread;
+	bool stopping{ false };
+};
+
+/**
+	A PrimeLookahead hands out the primes of a PrimeSource in order, starting at a 
+	given index. It keeps a bounded ring buffer of the next primes, which the 
+	producer of its source refills in the background, so popping a prime is a couple
+	of atomic operations and no system call as long as the buffer is not empty.
+
+	Once the consumer has drained the buffer down to the low watermark, the 
+	lookahead asks the producer to refill it up to its capacity, the high 
+	watermark. Only one thread may pop primes. Other lookaheads and threads can use
+	the same source, and the lookaheads on a source share one producer thread.
+
+	Nothing is produced before the first pop. If the source throws, the exception is
+	rethrown by the pop that reaches the prime that failed.
+*/
+template <typename P, typename Store>
+class PrimeLookahead
+{
+	friend class PrimeLookaheadProducer<P, Store>;
+
+public:
+	/**
+		This constructor creates a lookahead of at least capacity primes over a source,
+		starting at the prime with index 0. A refill is requested once at most
+		lowWatermark primes are left in the buffer.
+	*/
+	PrimeLookahead(PrimeSource<P, Store>& source, size_t capacity = 64, size_t lowWatermark = 16)
+		: source(source), producer(PrimeLookaheadProducer<P, Store>::getShared(source)), lowWatermark(lowWatermark), 
+		nextIndex(0), head(0), tail(0), stopping(false), refillRequested(false), consumerWaiting(false)
+	{
+		size_t size = 2;
+
+		while (size < capacity)
+		{
+			size *= 2;
+		}
+
+		buffer.resize(size);
+
+		if (this->lowWatermark >= size)
+		{
+			this->lowWatermark = size / 2;
+		}
+	}
+
+	PrimeLookahead(const PrimeLookahead&) = delete;
+	PrimeLookahead& operator=(const PrimeLookahead&) = delete;
+
+	~PrimeLookahead()
+	{
+		stop();
+	}
+
+	/**
+		Returns the next prime in order. This only blocks if the buffer is empty.
+	*/
+	P pop()
+	{
+		size_t index = head.load(std::memory_order_relaxed);
+
+		if (index == tail.load(std::memory_order_acquire))
+		{
+			waitForProducer(index);
+		}
+
+		P prime = buffer[index & (buffer.size() - 1)];
+
+		head.store(index + 1);
+		numPopped.add();
+
+		/*
+			Ask for a refill once the buffer has drained to the low watermark. The
+			producer clears the request before it reads the head, so a request made
+			while it fills is not lost.
+		*/
+		if (tail.load(std::memory_order_acquire) - (index + 1) <= lowWatermark)
+		{
+			requestRefill();
+		}
+
+		return prime;
+	}
+
+	/**
+		Discards the buffered primes and continues with the prime at the given index.
+	*/
+	void restart(size_t index)
+	{
+		stop();
+		reset(index);
+	}
+
+	/**
+		Returns the counters of this lookahead. This may be called from any thread.
+	*/
+	PrimeLookaheadStatistics getStatistics() const
+	{
+		PrimeLookaheadStatistics statistics;
+		statistics.numPopped = numPopped.load();
+		statistics.numProduced = numProduced.load();
+		statistics.numStalls = numStalls.load();
+		statistics.stallNanoseconds = stallNanoseconds.load();
+		statistics.numProducerWakeups = numProducerWakeups.load();
+		statistics.stallTimes = stallTimes.snapshot();
+
+		return statistics;
+	}
+
+	/**
+		Returns the producer that refills this lookahead, which every lookahead on the
+		same source shares.
+	*/
+	std::shared_ptr<PrimeLookaheadProducer<P, Store>> getProducer() const
+	{
+		return producer;
+	}
+
+private:
+	/**
+		Queues this lookahead with the producer unless it is queued already.
+	*/
+	void requestRefill()
+	{
+		if (!refillRequested.exchange(true))
+		{
+			producer->request(this);
+		}
+	}
+
+	/**
+		Stops a refill that is queued or running, and waits until it has stopped.
+	*/
+	void stop()
+	{
+		stopping = true;
+		producer->cancel(this);
+		refillRequested = false;
+	}
+
+	/**
+		Empties the buffer and continues with the prime at the given index. No refill
+		may be queued or running.
+	*/
+	void reset(size_t index)
+	{
+		head = 0;
+		tail = 0;
+		nextIndex = index;
+		error = nullptr;
+		stopping = false;
+	}
+
+	/**
+		This is called on the producer thread. It calculates primes into the buffer 
+		until it is full.
+	*/
+	void fill()
+	{
+		refillRequested = false;
+		numProducerWakeups.add();
+
+		while (!stopping)
+		{
+			size_t index = tail.load(std::memory_order_relaxed);
+
+			if (index - head.load() == buffer.size())
+			{
+				return;
+			}
+
+			try
+			{
+				buffer[index & (buffer.size() - 1)] = source.getPrimeNumber(nextIndex);
+			}
+			catch (...)
+			{
+				/*
+					The consumer finds the error once it has popped every prime before it.
+				*/
+				std::lock_guard<std::mutex> lock(mutex);
+				error = std::current_exception();
+				consumerWake.notify_one();
+				return;
+			}
+
+			nextIndex++;
+			tail.store(index + 1);
+			numProduced.add();
+
+			if (consumerWaiting)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				consumerWake.notify_one();
+			}
+		}
+	}
+
+	/**
+		Blocks until the producer has filled the buffer slot at index, and rethrows the
+		error of the producer if it failed instead.
+	*/
+	void waitForProducer(size_t index)
+	{
+		StatisticsTimer timer;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+
+			consumerWaiting = true;
+			requestRefill();
+			consumerWake.wait(lock, [&]() { return tail.load() != index || error; });
+			consumerWaiting = false;
+
+			if (tail.load() == index)
+			{
+				std::exception_ptr failure = error;
+				lock.unlock();
+
+				/*
+					Another refill may have been queued before this one failed, so the
+					producer index is only read once no refill runs. The primes it produced
+					past the failed one are discarded, and the next pop tries that prime
+					again.
+				*/
+				stop();
+				reset(nextIndex - (tail.load() - index));
+				std::rethrow_exception(failure);
+			}
+		}
+
+		uint64_t nanoseconds = timer.getNanoseconds();
+
+		numStalls.add();
+		stallNanoseconds.add(nanoseconds);
+		stallTimes.record(nanoseconds);
+	}
+
+	/**
+		The source of the primes. Only the producer thread asks it for primes.
+	*/
+	PrimeSource<P, Store>& source;
+
+	std::shared_ptr<PrimeLookaheadProducer<P, Store>> producer;
+
+	/**
+		The ring buffer of calculated primes. Its size is a power of two, and the slot
+		of a position is the position modulo the size.
+	*/
+	std::vector<P> buffer;
+
+	size_t lowWatermark;
+
+	/**
+		The index in the source of the next prime the producer calculates.
+	*/
+	size_t nextIndex;
+
+	/**
+		The position of the next prime to pop and the position after the last prime
+		produced. Both only grow.
+	*/
+	std::atomic<size_t> head;
+	std::atomic<size_t> tail;
+
+	/**
+		This tells a refill to stop early.
+	*/
+	std::atomic<bool> stopping;
+
+	/**
+		This is set while the lookahead is queued with the producer, so that it is
+		queued only once.
+	*/
+	std::atomic<bool> refillRequested;
+
+	/**
+		This tells the producer whether the consumer is blocked, so that the mutex is
+		only taken when it has to be woken.
+	*/
+	std::atomic<bool> consumerWaiting;
+
+	std::mutex mutex;
+	std::condition_variable consumerWake;
+
+	/**
+		The error the producer stopped with, if any.
+	*/
+	std::exception_ptr error;
+
+	/**
+		The statistics of the lookahead. They can be read from any thread.
+	*/
+	StatisticsCounter numPopped;
+	StatisticsCounter numProduced;
+	StatisticsCounter numStalls;
+	StatisticsCounter stallNanoseconds;
+	StatisticsCounter numProducerWakeups;
+	StatisticsHistogram stallTimes;
+};
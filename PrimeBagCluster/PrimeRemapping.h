@@ -0,0 +1,191 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+/**
+	A PrimeRemapping records how a PrimeTable moved values to other primes. It is a
+	list of the primes that changed, each with the prime its value has now, ordered
+	by the old prime. Primes that are not in the list kept their value.
+
+	A bag encoded under the old assignment is re-encoded by dividing out every old
+	prime it contains and multiplying in the new one.
+*/
+template <typename P>
+class PrimeRemapping
+{
+public:
+	/**
+		One prime that changed and the prime that replaces it.
+	*/
+	struct Entry
+	{
+		P oldPrime;
+		P newPrime;
+	};
+
+	typedef typename std::vector<Entry>::const_iterator const_iterator;
+
+	/**
+		Adds a prime that changed. The entries have to be added in order of the old
+		prime, or sorted afterwards.
+	*/
+	void add(P oldPrime, P newPrime)
+	{
+		entries.push_back(Entry{ oldPrime, newPrime });
+	}
+
+	/**
+		Orders the entries by the old prime.
+	*/
+	void sort()
+	{
+		std::sort(entries.begin(), entries.end(), [](const Entry& entry, const Entry& other)
+		{
+			return entry.oldPrime < other.oldPrime;
+		});
+	}
+
+	/**
+		Returns the prime that replaces a prime, which is the prime itself if it did
+		not change.
+	*/
+	P map(P prime) const
+	{
+		auto iter = std::lower_bound(entries.begin(), entries.end(), prime, [](const Entry& entry, P prime)
+		{
+			return entry.oldPrime < prime;
+		});
+
+		return iter != entries.end() && iter->oldPrime == prime ? iter->newPrime : prime;
+	}
+
+	const_iterator begin() const
+	{
+		return entries.begin();
+	}
+
+	const_iterator end() const
+	{
+		return entries.end();
+	}
+
+	/**
+		Returns the number of primes that changed.
+	*/
+	size_t size() const
+	{
+		return entries.size();
+	}
+
+	bool empty() const
+	{
+		return entries.empty();
+	}
+
+private:
+	std::vector<Entry> entries;
+};
+
+template <typename P>
+class PrimeRemapListenerList;
+
+/**
+	A PrimeRemapListener is told about every remapping of the PrimeTable it is
+	registered with, right after the table has moved the values. The listeners of a
+	table are linked through the listeners themselves, so registering one does not
+	allocate. A copy of a listener is not registered.
+*/
+template <typename P>
+class PrimeRemapListener
+{
+	friend class PrimeRemapListenerList<P>;
+
+public:
+	PrimeRemapListener()
+	{
+	}
+
+	PrimeRemapListener(const PrimeRemapListener<P>&)
+	{
+	}
+
+	PrimeRemapListener<P>& operator=(const PrimeRemapListener<P>&)
+	{
+		return *this;
+	}
+
+	virtual ~PrimeRemapListener()
+	{
+	}
+
+	virtual void remap(const PrimeRemapping<P>& remapping) = 0;
+
+private:
+	PrimeRemapListener<P>* previousListener{ nullptr };
+	PrimeRemapListener<P>* nextListener{ nullptr };
+};
+
+/**
+	A PrimeRemapListenerList is the doubly linked list of the listeners of a table.
+	Adding and removing a listener take constant time.
+*/
+template <typename P>
+class PrimeRemapListenerList
+{
+public:
+	/**
+		Adds a listener, which must not be in a list already.
+	*/
+	void add(PrimeRemapListener<P>* listener)
+	{
+		listener->previousListener = nullptr;
+		listener->nextListener = firstListener;
+
+		if (firstListener)
+		{
+			firstListener->previousListener = listener;
+		}
+
+		firstListener = listener;
+	}
+
+	/**
+		Removes a listener that is in this list.
+	*/
+	void remove(PrimeRemapListener<P>* listener)
+	{
+		if (listener->previousListener)
+		{
+			listener->previousListener->nextListener = listener->nextListener;
+		}
+		else
+		{
+			firstListener = listener->nextListener;
+		}
+
+		if (listener->nextListener)
+		{
+			listener->nextListener->previousListener = listener->previousListener;
+		}
+
+		listener->previousListener = nullptr;
+		listener->nextListener = nullptr;
+	}
+
+	/**
+		Tells every listener about a remapping.
+	*/
+	void remap(const PrimeRemapping<P>& remapping) const
+	{
+		for (PrimeRemapListener<P>* listener = firstListener; listener; listener = listener->nextListener)
+		{
+			listener->remap(remapping);
+		}
+	}
+
+private:
+	PrimeRemapListener<P>* firstListener{ nullptr };
+};
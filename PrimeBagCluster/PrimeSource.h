@@ -0,0 +1,131 @@
+#pragma once
+
+#include "SieveOfEratosthenes.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/**
+	A PrimeSource is a thread-safe Sieve of Eratosthenes that any number of PrimeTables
+	can share, so a process that holds many tables calculates and stores each prime
+	only once. Tables hold a source through a std::shared_ptr and only keep their own
+	assignments of values to primes.
+
+	Primes that have already been calculated are read without a lock. Sieving further
+	is serialized by a mutex, so only one thread extends the store at a time while
+	the others keep reading it.
+
+	The type parameters are those of SieveOfEratosthenes.
+*/
+template <typename P = uint32_t, typename Store = PrimeStore<P>>
+class PrimeSource
+{
+public:
+	/**
+		This constructor creates a source whose sieve starts with an optional ordered
+		vector of prime numbers.
+	*/
+	PrimeSource(const std::vector<P>* primeNumbers = nullptr) : sieve(primeNumbers)
+	{
+	}
+
+	/**
+		This constructor creates a source whose sieve continues from the primes of a
+		mapped prime file.
+	*/
+	PrimeSource(std::shared_ptr<const PrimeFile> primeFile) : sieve(primeFile)
+	{
+	}
+
+	PrimeSource(const PrimeSource&) = delete;
+	PrimeSource& operator=(const PrimeSource&) = delete;
+
+	/**
+		Returns the process-wide source for this prime and store type. It is created
+		when it is first needed and destroyed when the last table using it is.
+	*/
+	static std::shared_ptr<PrimeSource> getShared()
+	{
+		static std::mutex registryMutex;
+		static std::weak_ptr<PrimeSource> registry;
+
+		std::lock_guard<std::mutex> lock(registryMutex);
+		std::shared_ptr<PrimeSource> source = registry.lock();
+
+		if (!source)
+		{
+			source = std::make_shared<PrimeSource>();
+			registry = source;
+		}
+
+		return source;
+	}
+
+	/**
+		Returns the prime number at a specified index starting at 0, sieving further if
+		it has not been calculated yet. This may be called from any thread. Throws
+		std::overflow_error if the prime at that index does not fit in P.
+	*/
+	P getPrimeNumber(size_t index)
+	{
+		const Store& primes = sieve.getCalculatedPrimes();
+
+		if (index < primes.size())
+		{
+			return primes[index];
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		return sieve.getPrimeNumber(index);
+	}
+
+	/**
+		Returns the store containing all currently calculated prime numbers. It can be
+		read from any thread while the source sieves further.
+	*/
+	const Store& getCalculatedPrimes() const
+	{
+		return sieve.getCalculatedPrimes();
+	}
+
+	/**
+		Writes all currently calculated prime numbers to a prime file.
+	*/
+	void save(const std::string& path) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		sieve.save(path);
+	}
+
+	/**
+		Returns the statistics of the sieve. This may be called from any thread, and
+		does not wait for a sieve pass to finish.
+	*/
+	SieveStatistics getSieveStatistics() const
+	{
+		return sieve.getStatistics();
+	}
+
+	/**
+		Sets the number of threads used to sieve large ranges.
+	*/
+	void setNumThreads(uint threads)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		sieve.setNumThreads(threads);
+	}
+
+private:
+	/**
+		This mutex is held while the sieve calculates primes or is reconfigured.
+	*/
+	mutable std::mutex mutex;
+
+	SieveOfEratosthenes<P, Store> sieve;
+};
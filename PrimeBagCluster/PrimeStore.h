@@ -0,0 +1,253 @@
+#pragma once
+
+#include "PrimeFile.h"
+#include "ChunkedArray.h"
+#include <vector>
+#include <memory>
+#include <iterator>
+#include <cstddef>
+#include <cstdint>
+
+/**
+	A PrimeStore holds an ordered list of prime numbers. The front of the list can be
+	a read-only region of a memory mapped PrimeFile, which is used in place without
+	copying it. Every prime appended after that goes into an overflow array, so the
+	mapped pages stay shared between all processes that map the same file.
+
+	One thread may append primes while any number of other threads read them. The
+	overflow array is chunked and never reallocates, and appended primes only become
+	visible through size() once they are written. An iterator range taken from 
+	begin() and end() is a snapshot that stays valid while the store grows.
+
+	The type parameter P is the word type of the stored primes.
+*/
+template <typename P>
+class PrimeStore
+{
+public:
+	typedef P value_type;
+
+	/**
+		This is a random access iterator over the primes of a store.
+	*/
+	class const_iterator
+	{
+	public:
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef P value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const P* pointer;
+		typedef const P& reference;
+
+		const_iterator(const PrimeStore* store = nullptr, size_t index = 0) : store(store), index(index)
+		{
+		}
+
+		const P& operator*() const
+		{
+			return (*store)[index];
+		}
+
+		const P& operator[](difference_type offset) const
+		{
+			return (*store)[index + offset];
+		}
+
+		const_iterator& operator++()
+		{
+			index++;
+			return *this;
+		}
+
+		const_iterator operator++(int)
+		{
+			const_iterator copy = *this;
+			index++;
+			return copy;
+		}
+
+		const_iterator& operator--()
+		{
+			index--;
+			return *this;
+		}
+
+		const_iterator operator--(int)
+		{
+			const_iterator copy = *this;
+			index--;
+			return copy;
+		}
+
+		const_iterator& operator+=(difference_type offset)
+		{
+			index += offset;
+			return *this;
+		}
+
+		const_iterator& operator-=(difference_type offset)
+		{
+			index -= offset;
+			return *this;
+		}
+
+		const_iterator operator+(difference_type offset) const
+		{
+			return const_iterator(store, index + offset);
+		}
+
+		const_iterator operator-(difference_type offset) const
+		{
+			return const_iterator(store, index - offset);
+		}
+
+		difference_type operator-(const const_iterator& other) const
+		{
+			return difference_type(index) - difference_type(other.index);
+		}
+
+		bool operator==(const const_iterator& other) const
+		{
+			return index == other.index;
+		}
+
+		bool operator!=(const const_iterator& other) const
+		{
+			return index != other.index;
+		}
+
+		bool operator<(const const_iterator& other) const
+		{
+			return index < other.index;
+		}
+
+		bool operator>(const const_iterator& other) const
+		{
+			return index > other.index;
+		}
+
+		bool operator<=(const const_iterator& other) const
+		{
+			return index <= other.index;
+		}
+
+		bool operator>=(const const_iterator& other) const
+		{
+			return index >= other.index;
+		}
+
+	private:
+		const PrimeStore* store;
+		size_t index;
+	};
+
+	/**
+		This constructor creates an empty store.
+	*/
+	PrimeStore() : mapped(nullptr), numMapped(0)
+	{
+	}
+
+	/**
+		This constructor creates a store whose front is the list of primes in a mapped
+		prime file. The store keeps the mapping alive. Throws std::runtime_error if the
+		file stores primes of a different word size.
+	*/
+	PrimeStore(std::shared_ptr<const PrimeFile> file)
+		: file(file), mapped(file->getPrimes<P>()), numMapped(file->getNumPrimes())
+	{
+	}
+
+	/**
+		Returns the prime number at the given index.
+	*/
+	const P& operator[](size_t index) const
+	{
+		return index < numMapped ? mapped[index] : overflow[index - numMapped];
+	}
+
+	/**
+		Returns the number of primes in the store.
+	*/
+	size_t size() const
+	{
+		return numMapped + overflow.size();
+	}
+
+	bool empty() const
+	{
+		return !size();
+	}
+
+	const P& back() const
+	{
+		return (*this)[size() - 1];
+	}
+
+	const_iterator begin() const
+	{
+		return const_iterator(this, 0);
+	}
+
+	const_iterator end() const
+	{
+		return const_iterator(this, size());
+	}
+
+	/**
+		Returns the number of primes the store can hold before the overflow array has
+		to allocate another chunk.
+	*/
+	size_t capacity() const
+	{
+		return numMapped + overflow.capacity();
+	}
+
+	void reserve(size_t numPrimes)
+	{
+		if (numPrimes > numMapped)
+		{
+			overflow.reserve(numPrimes - numMapped);
+		}
+	}
+
+	void push_back(P prime)
+	{
+		overflow.push_back(prime);
+	}
+
+	/**
+		Appends an ordered range of primes that are all larger than the last prime.
+		They are published to readers together.
+	*/
+	template <typename Iterator>
+	void append(Iterator first, Iterator last)
+	{
+		overflow.append(first, last);
+	}
+
+	/**
+		Returns the number of primes that are read directly from a mapped file.
+	*/
+	size_t getNumMapped() const
+	{
+		return numMapped;
+	}
+
+private:
+	/**
+		The mapped file that the front of the store is read from, if any.
+	*/
+	std::shared_ptr<const PrimeFile> file;
+
+	/**
+		The primes in the mapped region of the file.
+	*/
+	const P* mapped;
+	size_t numMapped;
+
+	/**
+		The primes that come after the mapped region.
+	*/
+	ChunkedArray<P> overflow;
+};
@@ -2,21 +2,111 @@
 
 
 #include "PrimeTable.h"
-#include "SieveOfEratosthenes.h"
-#include <unordered_map>
+#include "PrimeSource.h"
+#include "PrimeLookahead.h"
+#include "FlatHashMap.h"
+#include "NodeHashMap.h"
+#include "TransparentHash.h"
+#include "PrimeRemapping.h"
+#include "PrimeTableView.h"
+#include "Statistics.h"
+#include "WordDivisor.h"
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
 #include <queue>
-#include <future>
 #include <boost/multiprecision/cpp_int.hpp>
 
 /**
-	PrimeTable objects are used to assign unique prime numbers to values. The
-	underlying data structure is a hash map with type parameter V being the key 
-	type and the corresponding values are unsigned prime ints.
+	These are the statistics of a PrimeTable. A hit is an add of a value that is in
+	the table already, and a miss is an add that assigns a prime, which may be a 
+	reused hole. A remapping is a rerank or compaction. The value count, map capacity 
+	and highest prime are gauges that are read from the table when the statistics
+	are taken, so they cost nothing while it is changed.
+*/
+struct PrimeTableStatistics
+{
+	uint64_t numHits;
+	uint64_t numMisses;
+	uint64_t numHoleReuses;
+	uint64_t numRemoves;
+	uint64_t numRemappings;
+	uint64_t numValues;
+	uint64_t mapCapacity;
+
+	/**
+		The largest prime handed out, or 0 if the table is empty.
+	*/
+	uint64_t highestPrime;
+
+	PrimeLookaheadStatistics lookahead;
+	SieveStatistics sieve;
+
+	/**
+		Returns the fraction of the hash map slots that hold a value.
+	*/
+	double getLoadFactor() const
+	{
+		return mapCapacity ? double(numValues) / double(mapCapacity) : 0.0;
+	}
+};
+
+/**
+	This map policy makes a PrimeTable find the index of a value with an open
+	addressing FlatHashMap, which keeps its elements inline and needs no allocation
+	per insert.
+*/
+struct FlatMapPolicy
+{
+	template <typename K, typename T, typename Hash, typename KeyEqual>
+	using map_type = FlatHashMap<K, T, Hash, KeyEqual>;
+};
+
+/**
+	This map policy makes a PrimeTable find the index of a value with a node-based
+	NodeHashMap on top of the standard unordered containers.
+*/
+struct NodeMapPolicy
+{
+	template <typename K, typename T, typename Hash, typename KeyEqual>
+	using map_type = NodeHashMap<K, T, Hash, KeyEqual>;
+};
+
+/**
+	PrimeTable objects are used to assign unique prime numbers to values. Every 
+	assigned prime has a dense index into the list of prime numbers, and the values
+	are kept in a vector at the index of their prime, so finding the value of a prime
+	is array indexing. A hash map of indices into that vector finds the prime of a
+	value. Each value is stored only once.
+
+	Primes are handed out first come, first served. A table can optionally count how
+	often each value is added and rerank its values, so that the most frequent ones
+	get the smallest primes and the bags that hold them stay small. Bags register 
+	with their table and are re-encoded whenever it reranks.
+
+	Bags also count a reference for every value they hold. A referenced value cannot
+	be removed, and it is removed by itself once the last reference to it is 
+	released, so the vocabulary of a table can be collected while it is used.
 
 	The space complexity of a PrimeTable is O(N) where N = the number of unique
-	values added to the table.
+	values added to the table. The primes themselves come from a PrimeSource, which
+	is shared by every table of the same prime and store type unless a table is given
+	its own.
+
+	The type parameter P is the word type of the assigned primes. uint32_t keeps the
+	table compact and holds about 200 million values, and uint64_t lets the table grow
+	past that. The type parameter Store is the container of calculated primes used by
+	the sieve. A CompactPrimeStore<P> takes about a quarter of the memory of the 
+	default PrimeStore<P> at the cost of slower random access. The type parameter
+	MapPolicy chooses the hash map that finds the index of a value.
+
+	The methods that look a value up accept any key that compares equal to V and 
+	hashes alike under TransparentHash<V>, so a table of std::string can be searched
+	with a std::string_view or a character array without copying it.
 */
-template <typename V>
+template <typename V, typename P = uint32_t, typename Store = PrimeStore<P>, typename MapPolicy = FlatMapPolicy>
 class PrimeTable
 {
 	typedef boost::multiprecision::cpp_int bignum;
@@ -24,83 +114,287 @@ class PrimeTable
 	typedef unsigned int uint;
 
 public:
+	typedef V value_type;
+	typedef P prime_type;
+	typedef Store store_type;
+	typedef MapPolicy map_policy;
+
+	/**
+		This constructor attaches the table to the process-wide prime source. If a
+		pointer to a vector of prime numbers is given, the table gets its own source 
+		that starts with those primes instead.
+	*/
+	PrimeTable(const std::vector<P>* primeNumbers = nullptr)
+		: source(primeNumbers ? std::make_shared<PrimeSource<P, Store>>(primeNumbers) : PrimeSource<P, Store>::getShared()), 
+		lookahead(*source), primeMap(ValueHash(values), ValueEqual(values))
+	{
+	}
+
 	/**
-		This constructor initializes the Sieve of Eratosthenes with an optional
-		pointer to a vector of prime numbers.
+		This constructor gives the table its own prime source, which uses the primes of
+		a mapped prime file in place without copying them.
 	*/
-	PrimeTable(const std::vector<uint>* primeNumbers = nullptr)
-		: sieveOfEratosthenes(primeNumbers)
+	PrimeTable(std::shared_ptr<const PrimeFile> primeFile)
+		: source(std::make_shared<PrimeSource<P, Store>>(primeFile)), lookahead(*source),
+		primeMap(ValueHash(values), ValueEqual(values))
 	{
 	}
 
+	/**
+		This constructor attaches the table to the given prime source.
+	*/
+	PrimeTable(std::shared_ptr<PrimeSource<P, Store>> source)
+		: source(source), lookahead(*this->source), primeMap(ValueHash(values), ValueEqual(values))
+	{
+	}
+
+	/**
+		This constructor restores a table that was saved to a table file, on the prime
+		source of the view. Every value gets the prime it had, the holes are reused in
+		the same order, and new values continue after the last prime the saved table
+		handed out, so bags encoded with the saved table keep decoding. Reference and
+		usage counts are not saved, and registered bags count their references again.
+
+		Every value is decoded and indexed here, which takes O(N) time and memory for
+		N values. A PrimeTableView answers queries from the file without loading it,
+		and is the way to use a snapshot that is only read.
+	*/
+	PrimeTable(const PrimeTableView<V, P, Store>& view)
+		: source(view.getPrimeSource()), lookahead(*source), primeMap(ValueHash(values), ValueEqual(values))
+	{
+		const PrimeTableFile& file = *view.getFile();
+		size_t numIndices = file.getNumIndices();
+
+		values.resize(numIndices);
+		assigned.resize(numIndices, true);
+		referenceCounts.resize(numIndices);
+		inverses.reserve(numIndices);
+
+		for (size_t hole = 0; hole < file.getNumHoles(); hole++)
+		{
+			P index = P(file.getHole(hole));
+
+			/*
+				A hole that is in the file twice would be handed out twice.
+			*/
+			if (!assigned[index])
+			{
+				throw std::runtime_error("The table file has a hole twice.");
+			}
+
+			assigned[index] = false;
+			primeHoles.push(index);
+		}
+
+		primeMap.reserve(file.getNumValues());
+
+		auto cursor = view.getPrimeNumbers().begin();
+
+		for (size_t index = 0; index < numIndices; index++, ++cursor)
+		{
+			P prime = *cursor;
+
+			while (blockIndices.size() <= size_t(prime >> blockShift))
+			{
+				blockIndices.push_back(P(index));
+			}
+
+			if (assigned[index])
+			{
+				values[index] = ValueCodec<V>::decode(file.getValueBytes(index));
+				primeMap.emplace(ValueIndex{ P(index) }, prime);
+			}
+
+			inverses.push_back(WordDivisor::invert(prime));
+		}
+
+		lookahead.restart(numIndices);
+	}
+
 	/**
 		This method adds a value to the table and assigns it a unique prime number.
 		Returns the prime number associated with the given value.
 	*/
-	uint add(const V& value)
+	P add(const V& value)
 	{
-		uint prime{ 0 };
+		return insert(value, 0);
+	}
 
-		const auto& iter = primeMap.find(value);
+	/**
+		Adds a value like add and counts one more reference to it. Bags hold a
+		reference for every occurrence of a value.
+	*/
+	P addReference(const V& value)
+	{
+		return insert(value, 1);
+	}
+
+	/**
+		Adds every value of a range like add and writes the prime of each one to an
+		output range, in input order. Returns the end of the output range.
+
+		Values that are new to the table get their indices in a single pass, so
+		repeated values in the input are only added once, and all the new primes are
+		calculated by one call to the sieve instead of being handed out one by one.
+		Throws std::overflow_error without adding anything new if the primes do not
+		fit in P.
+	*/
+	template <typename InputIterator, typename OutputIterator>
+	OutputIterator addAll(InputIterator first, InputIterator last, OutputIterator out)
+	{
+		size_t oldSize = values.size();
 
 		/*
-			If the number is not already contained in the table
+			The index of every input value. The primes of new values are not known
+			until the sieve has run, so they are inserted into the map as 0 for now.
 		*/
-		if (iter == primeMap.end())
+		std::vector<P> indices;
+		std::vector<P> newIndices;
+
+		for (; first != last; ++first)
 		{
-			/*
-				If there are prime numbers in the primeHoles queue, those should be
-				prioritized to improve efficiency.
-			*/
-			if (primeHoles.size())
+			const V& value = *first;
+			const auto& iter = primeMap.find(value);
+			P index;
+
+			if (iter != primeMap.end())
 			{
-				prime = primeHoles.top();
-				primeHoles.pop();
+				index = iter->first.index;
 			}
 			else
 			{
-				/*
-					If there is a precalculated prime number use that
-				*/
-				if (nextPrime.valid())
+				if (primeHoles.size())
 				{
-					prime = nextPrime.get();
+					index = primeHoles.top();
+					primeHoles.pop();
+
+					values[index] = value;
+					assigned[index] = true;
 				}
-				/*
-					If not, calculate the next number. This usually only has to be once on the first insertion.
-				*/
 				else
 				{
-					prime = sieveOfEratosthenes.getPrimeNumber(primeMap.size());
+					index = P(values.size());
+
+					values.push_back(value);
+					assigned.push_back(true);
+					referenceCounts.push_back(0);
 				}
 
+				primeMap.emplace(ValueIndex{ index }, P(0));
+				newIndices.push_back(index);
+			}
+
+			indices.push_back(index);
+		}
+
+		const Store& primes = source->getCalculatedPrimes();
+
+		if (values.size() > oldSize)
+		{
+			try
+			{
+				source->getPrimeNumber(values.size() - 1);
+			}
+			catch (...)
+			{
 				/*
-					Precalculate the next prime number.
+					Take back the values that did not get a prime. Holes did, since their
+					primes were handed out before. No reference or usage has been counted
+					for the input yet, so the counts are as they were.
 				*/
-				nextPrime = std::async(std::launch::async, &SieveOfEratosthenes::getPrimeNumber, &sieveOfEratosthenes, primeMap.size() + 1);
+				for (P index : newIndices)
+				{
+					if (index >= oldSize)
+					{
+						primeMap.erase(ValueIndex{ index });
+					}
+					else
+					{
+						release(index);
+					}
+				}
+
+				values.resize(oldSize);
+				assigned.resize(oldSize);
+				referenceCounts.resize(oldSize);
+				throw;
 			}
-			
+
+			for (size_t index = oldSize; index < values.size(); index++)
+			{
+				while (blockIndices.size() <= size_t(primes[index] >> blockShift))
+				{
+					blockIndices.push_back(P(index));
+				}
+
+				inverses.push_back(WordDivisor::invert(primes[index]));
+			}
+
 			/*
-				Insert the value and prime into the map
+				The lookahead continues after the primes that were just handed out.
 			*/
-			primeMap[value] = prime;
-			reversePrimeMap[prime] = value;
+			lookahead.restart(values.size());
+		}
+
+		/*
+			The usage is only counted once every value has its prime, so a failed add
+			leaves the counts alone.
+		*/
+		if (rerankingEnabled)
+		{
+			for (P index : indices)
+			{
+				countUsage(index);
+			}
+		}
+
+		numHits.add(indices.size() - newIndices.size());
+		numMisses.add(newIndices.size());
+		numHoleReuses.add(newIndices.size() - (values.size() - oldSize));
+
+		/*
+			Fill in the primes of the new values. If there are many of them, one pass
+			over the map is cheaper than looking each of them up again.
+		*/
+		if (newIndices.size() > primeMap.size() / 8)
+		{
+			for (auto& entry : primeMap)
+			{
+				if (!entry.second)
+				{
+					entry.second = primes[entry.first.index];
+				}
+			}
 		}
 		else
 		{
-			/*
-				If the value is already contained, return the prime associated.
-			*/
-			prime = iter->second;
+			for (P index : newIndices)
+			{
+				primeMap.find(ValueIndex{ index })->second = primes[index];
+			}
 		}
 
-		return prime;
+		PrimeRemapping<P> remapping;
+
+		if (rerankThreshold && (numAddsSinceRerank += indices.size()) >= rerankThreshold)
+		{
+			remapping = rerank();
+		}
+
+		for (P index : indices)
+		{
+			*out = remapping.map(primes[index]);
+			++out;
+		}
+
+		return out;
 	}
 
 	/**
 		Returns the prime number associated with a value. Returns 0 if it could not be found.
 	*/
-	uint getPrime(const V& value) const
+	template <typename Key>
+	P getPrime(const Key& value) const
 	{
 		const auto& iter = primeMap.find(value);
 
@@ -115,24 +409,52 @@ public:
 	}
 
 	/**
-		This method removes a value from the prime table. Returns 0 if the
-		value is not contained in the table, and returns the associated prime number
-		if the value was successfully removed. This could potentially run in O(N) 
-		time where N = the number of prime numbers that have been erased from the map
-		without being reassigned.
+		Returns a divisor for the prime of a value, which tests bags for the value
+		without a hardware division. The divisor is empty if the value could not be
+		found.
 	*/
-	uint remove(const V& value)
+	template <typename Key>
+	WordDivisor getDivisor(const Key& value) const
 	{
 		const auto& iter = primeMap.find(value);
 
 		if (iter != primeMap.end())
 		{
-			uint prime = iter->second;
+			return WordDivisor(iter->second, inverses[iter->first.index]);
+		}
+		else
+		{
+			return WordDivisor();
+		}
+	}
+
+	/**
+		Returns the inverse that a WordDivisor uses for the prime at an index into the
+		list of prime numbers, up to the largest prime this table has handed out.
+	*/
+	ulong getInverseAt(size_t index) const
+	{
+		return inverses[index];
+	}
+
+	/**
+		This method removes a value from the prime table. Returns 0 if the
+		value is not contained in the table or is still referenced by a bag, and 
+		returns the associated prime number if the value was successfully removed. 
+		A referenced value is removed by itself once the last reference to it is 
+		released.
+	*/
+	template <typename Key>
+	P remove(const Key& value)
+	{
+		const auto& iter = primeMap.find(value);
 
-			primeHoles.push(prime);
+		if (iter != primeMap.end() && !referenceCounts[iter->first.index])
+		{
+			P prime = iter->second;
 
-			primeMap.erase(value);
-			reversePrimeMap.erase(prime);
+			release(iter->first.index);
+			numRemoves.add();
 
 			return prime;
 		}
@@ -140,87 +462,741 @@ public:
 		return 0;
 	}
 
+	/**
+		Counts more references to the value of an assigned prime.
+	*/
+	void addReferences(P prime, uint count = 1)
+	{
+		size_t index = getPrimeIndex(prime);
+
+		if (containsIndex(index))
+		{
+			referenceCounts[index] += count;
+		}
+	}
+
+	/**
+		Releases references to the value of an assigned prime. The value is removed
+		from the table and its prime is freed once no references are left.
+	*/
+	void releaseReferences(P prime, uint count = 1)
+	{
+		size_t index = getPrimeIndex(prime);
+
+		if (containsIndex(index) && referenceCounts[index])
+		{
+			referenceCounts[index] -= std::min(count, referenceCounts[index]);
+
+			if (!referenceCounts[index])
+			{
+				release(P(index));
+				numRemoves.add();
+			}
+		}
+	}
+
+	/**
+		Returns the number of references to a value.
+	*/
+	template <typename Key>
+	uint getReferenceCount(const Key& value) const
+	{
+		const auto& iter = primeMap.find(value);
+
+		return iter != primeMap.end() ? referenceCounts[iter->first.index] : 0;
+	}
+
 	/**
 		This function clears the entire table.
 	*/
 	void clear()
 	{
 		/*
-			Join the worker thread.
+			Start handing out primes from the first one again.
 		*/
-		nextPrime.get();
+		lookahead.restart(0);
 		
 		/*
-			Clear the hash maps.
+			Clear the hash map and the values.
 		*/
 		primeMap.clear();
-		reversePrimeMap.clear();
+		values.clear();
+		assigned.clear();
+		referenceCounts.clear();
+		blockIndices.clear();
+		inverses.clear();
+		usageCounts.clear();
+		numAddsSinceRerank = 0;
 
 		/*
 			Re initialize the prime holes queue.
 		*/
-		primeHoles;
+		primeHoles = HoleQueue();
+	}
+
+	/**
+		Starts counting how often each value is added. If threshold is not 0, the
+		table reranks by itself every threshold calls to add.
+	*/
+	void enableReranking(uint64_t threshold = 0)
+	{
+		rerankingEnabled = true;
+		rerankThreshold = threshold;
+		numAddsSinceRerank = 0;
+	}
+
+	/**
+		Stops counting how often values are added and forgets the counts.
+	*/
+	void disableReranking()
+	{
+		rerankingEnabled = false;
+		rerankThreshold = 0;
+		usageCounts = std::vector<uint64_t>();
+	}
+
+	/**
+		Returns how often a value has been added since reranking was enabled.
+	*/
+	template <typename Key>
+	uint64_t getUsageCount(const Key& value) const
+	{
+		const auto& iter = primeMap.find(value);
+
+		if (iter == primeMap.end() || iter->first.index >= usageCounts.size())
+		{
+			return 0;
+		}
+
+		return usageCounts[iter->first.index];
+	}
+
+	/**
+		Reassigns the primes of the table to its values in order of their usage 
+		counts, so that the most frequent value gets the smallest assigned prime. The
+		set of assigned primes does not change. Registered listeners are told about
+		the moved primes, and the remapping is returned for primes that are kept 
+		elsewhere.
+	*/
+	PrimeRemapping<P> rerank()
+	{
+		std::vector<P> indices;
+		indices.reserve(primeMap.size());
+
+		for (size_t index = 0; index < values.size(); index++)
+		{
+			if (assigned[index])
+			{
+				indices.push_back(P(index));
+			}
+		}
+
+		/*
+			The stable sort keeps values with equal counts where they are.
+		*/
+		std::vector<P> order = indices;
+
+		std::stable_sort(order.begin(), order.end(), [this](P index, P other)
+		{
+			return getUsageCountAt(index) > getUsageCountAt(other);
+		});
+
+		return renumber(order, indices);
 	}
 
 	/**
-		Returns the map of values to their primes.
+		Moves the values onto the smallest primes, in the order of their current 
+		primes, so that no holes are left. The primes above the last value are handed
+		out again by later adds. Registered listeners are told about the moved primes,
+		and the remapping is returned for primes that are kept elsewhere.
 	*/
-	const std::unordered_map<V, uint>& getPrimeMap() const
+	PrimeRemapping<P> compact()
 	{
-		return primeMap;
+		std::vector<P> from;
+		std::vector<P> to;
+		from.reserve(primeMap.size());
+		to.reserve(primeMap.size());
+
+		for (size_t index = 0; index < values.size(); index++)
+		{
+			if (assigned[index])
+			{
+				to.push_back(P(from.size()));
+				from.push_back(P(index));
+			}
+		}
+
+		PrimeRemapping<P> remapping = renumber(from, to);
+
+		/*
+			Drop everything past the last value and continue handing out primes right
+			after it.
+		*/
+		size_t numValues = to.size();
+
+		values.resize(numValues);
+		assigned.resize(numValues);
+		referenceCounts.resize(numValues);
+
+		if (usageCounts.size() > numValues)
+		{
+			usageCounts.resize(numValues);
+		}
+
+		while (!blockIndices.empty() && blockIndices.back() >= numValues)
+		{
+			blockIndices.pop_back();
+		}
+
+		inverses.resize(numValues);
+
+		primeHoles = HoleQueue();
+		lookahead.restart(numValues);
+
+		return remapping;
+	}
+
+	/**
+		Registers a listener that is told about every remapping of this table. The
+		listener must not be registered already, and must be removed before it is
+		destroyed.
+	*/
+	void addRemapListener(PrimeRemapListener<P>* listener)
+	{
+		listeners.add(listener);
+	}
+
+	void removeRemapListener(PrimeRemapListener<P>* listener)
+	{
+		listeners.remove(listener);
+	}
+
+	/**
+		Returns the number of values in the table.
+	*/
+	size_t size() const
+	{
+		return primeMap.size();
+	}
+
+	/**
+		Returns the number of primes this table has handed out, including the primes
+		of removed values. Every assigned prime has an index below it.
+	*/
+	size_t getNumIndices() const
+	{
+		return values.size();
 	}
 
 	/**
 		Returns whether or not a prime number has been assigned to a 
 		value in this table.
 	*/
-	bool containsPrime(uint prime) const
+	bool containsPrime(P prime) const
 	{
-		const auto& iter = reversePrimeMap.find(prime);
+		return containsIndex(getPrimeIndex(prime));
+	}
 
-		return iter != reversePrimeMap.end();
+	/**
+		Returns whether or not the prime at an index into the list of prime numbers 
+		has been assigned to a value in this table.
+	*/
+	bool containsIndex(size_t index) const
+	{
+		return index < assigned.size() && assigned[index];
 	}
 
 	/**
 		Returns the value associated with a given prime number. This
 		will throw an error if the given prime is not assigned to a value.
+		Callers that know the index of the prime should use getValueAt.
+	*/
+	const V& getValue(P prime) const
+	{
+		return getValueAt(getPrimeIndex(prime));
+	}
+
+	/**
+		Returns the value associated with the prime at an index into the list of
+		prime numbers. Throws std::out_of_range if that prime is not assigned to a 
+		value.
+	*/
+	const V& getValueAt(size_t index) const
+	{
+		if (!containsIndex(index))
+		{
+			throw std::out_of_range("The prime is not assigned to a value.");
+		}
+
+		return values[index];
+	}
+
+	/**
+		Returns the index of a prime number into the list of prime numbers. Only the 
+		primes up to the largest one this table has handed out are searched, and the
+		number of those is returned if the given number is not one of them.
+	*/
+	size_t getPrimeIndex(P prime) const
+	{
+		size_t block = size_t(prime >> blockShift);
+
+		if (block >= blockIndices.size())
+		{
+			return values.size();
+		}
+
+		/*
+			Search the few primes between the first prime of the block and the first
+			prime of the next one.
+		*/
+		size_t index = blockIndices[block];
+		size_t end = block + 1 < blockIndices.size() ? blockIndices[block + 1] : values.size();
+
+		auto cursor = source->getCalculatedPrimes().begin() + index;
+
+		for (; index < end; index++, ++cursor)
+		{
+			if (*cursor >= prime)
+			{
+				return *cursor == prime ? index : values.size();
+			}
+		}
+
+		return values.size();
+	}
+
+	/**
+		Writes the table to a table file, which can be mapped by a PrimeTableView and
+		restored later. Throws std::runtime_error if the file cannot be written.
+	*/
+	void save(const std::string& path) const
+	{
+		std::vector<uint64_t> offsets;
+		std::string arena;
+		offsets.reserve(values.size() + 1);
+
+		for (size_t index = 0; index < values.size(); index++)
+		{
+			offsets.push_back(arena.size());
+
+			if (assigned[index])
+			{
+				arena.append(ValueCodec<V>::encode(values[index]));
+			}
+		}
+
+		offsets.push_back(arena.size());
+
+		PrimeTableFile::write(path, sizeof(P), values.empty() ? 0 : ulong(source->getCalculatedPrimes()[values.size() - 1]),
+			offsets, assigned, arena);
+	}
+
+	/**
+		Returns the counters of the prime lookahead, which show the insert throughput
+		and how often an insert had to wait for a prime to be calculated.
+	*/
+	PrimeLookaheadStatistics getLookaheadStatistics() const
+	{
+		return lookahead.getStatistics();
+	}
+
+	/**
+		Returns the statistics of this table, its lookahead and the sieve of its prime
+		source. The gauges are read from the table itself, so this must not be called
+		while another thread changes the table.
+	*/
+	PrimeTableStatistics getStatistics() const
+	{
+		PrimeTableStatistics statistics;
+		statistics.numHits = numHits.load();
+		statistics.numMisses = numMisses.load();
+		statistics.numHoleReuses = numHoleReuses.load();
+		statistics.numRemoves = numRemoves.load();
+		statistics.numRemappings = numRemappings.load();
+		statistics.numValues = primeMap.size();
+		statistics.mapCapacity = primeMap.bucket_count();
+		statistics.highestPrime = values.empty() ? 0 : source->getCalculatedPrimes()[values.size() - 1];
+		statistics.lookahead = lookahead.getStatistics();
+		statistics.sieve = source->getSieveStatistics();
+
+		return statistics;
+	}
+
+	/**
+		Returns a list of all calculated prime numbers. The list can be read while the 
+		next prime is being calculated in the background, and an iterator range taken
+		from it stays valid as the list grows.
 	*/
-	const V& getValue(uint prime) const
+	const Store& getPrimeNumbers() const
 	{
-		return reversePrimeMap.at(prime);
+		return source->getCalculatedPrimes();
 	}
 
 	/**
-		Returns a list of all calculated prime numbers.
+		Returns the prime source of this table.
 	*/
-	const std::vector<uint>& getPrimeNumbers() const
+	std::shared_ptr<PrimeSource<P, Store>> getPrimeSource() const
 	{
-		return sieveOfEratosthenes.getCalculatedPrimes();
+		return source;
 	}
 private:
 	/**
-		This is task calculates the next prime number to be added ahead of time.
+		Assigns a prime to a value if it has none and adds references to it. Returns 
+		the prime of the value.
+	*/
+	P insert(const V& value, uint references)
+	{
+		P prime{ 0 };
+		P index;
+
+		const auto& iter = primeMap.find(value);
+
+		/*
+			If the number is not already contained in the table
+		*/
+		if (iter == primeMap.end())
+		{
+			/*
+				If there are prime numbers in the primeHoles queue, those should be
+				prioritized to improve efficiency. The smallest one is reused first,
+				which keeps the bags that get the value small.
+			*/
+			if (primeHoles.size())
+			{
+				index = primeHoles.top();
+				primeHoles.pop();
+
+				prime = source->getPrimeNumber(index);
+				values[index] = value;
+				assigned[index] = true;
+
+				numHoleReuses.add();
+			}
+			else
+			{
+				/*
+					Otherwise take the next unassigned prime, which has usually been 
+					calculated ahead of time. The lookahead hands out the primes in order,
+					so its index is the end of the value vector.
+				*/
+				prime = lookahead.pop();
+				index = P(values.size());
+
+				values.push_back(value);
+				assigned.push_back(true);
+				referenceCounts.push_back(0);
+
+				while (blockIndices.size() <= size_t(prime >> blockShift))
+				{
+					blockIndices.push_back(index);
+				}
+
+				inverses.push_back(WordDivisor::invert(prime));
+			}
+			
+			/*
+				Insert the index of the value and its prime into the map
+			*/
+			primeMap.emplace(ValueIndex{ index }, prime);
+
+			numMisses.add();
+		}
+		else
+		{
+			/*
+				If the value is already contained, return the prime associated.
+			*/
+			prime = iter->second;
+			index = iter->first.index;
+
+			numHits.add();
+		}
+
+		referenceCounts[index] += references;
+
+		if (rerankingEnabled)
+		{
+			countUsage(index);
+		}
+
+		/*
+			Rerank once enough values have been added since the last time. The value
+			may have moved to another prime.
+		*/
+		if (rerankThreshold && ++numAddsSinceRerank >= rerankThreshold)
+		{
+			rerank();
+			prime = getPrime(value);
+		}
+
+		return prime;
+	}
+
+	/**
+		Removes the value at an index and frees its prime for the next value.
+	*/
+	void release(P index)
+	{
+		primeMap.erase(ValueIndex{ index });
+		values[index] = V();
+		assigned[index] = false;
+		referenceCounts[index] = 0;
+
+		if (index < usageCounts.size())
+		{
+			usageCounts[index] = 0;
+		}
+
+		primeHoles.push(index);
+	}
+
+	uint64_t getUsageCountAt(P index) const
+	{
+		return index < usageCounts.size() ? usageCounts[index] : 0;
+	}
+
+	void countUsage(P index)
+	{
+		if (index >= usageCounts.size())
+		{
+			usageCounts.resize(size_t(index) + 1);
+		}
+
+		usageCounts[index]++;
+	}
+
+	/**
+		Moves the value at each index of from to the index at the same position of to,
+		rebuilds the hash map, and tells the listeners. Every index in to must either 
+		be free or be in from as well.
+	*/
+	PrimeRemapping<P> renumber(const std::vector<P>& from, const std::vector<P>& to)
+	{
+		const Store& primes = source->getCalculatedPrimes();
+		PrimeRemapping<P> remapping;
+
+		numRemappings.add();
+
+		std::vector<V> movedValues;
+		std::vector<uint64_t> movedCounts;
+		std::vector<uint> movedReferences;
+		movedValues.reserve(from.size());
+		movedCounts.reserve(from.size());
+		movedReferences.reserve(from.size());
+
+		for (P index : from)
+		{
+			movedValues.push_back(std::move(values[index]));
+			movedCounts.push_back(getUsageCountAt(index));
+			movedReferences.push_back(referenceCounts[index]);
+
+			values[index] = V();
+			assigned[index] = false;
+			referenceCounts[index] = 0;
+		}
+
+		if (rerankingEnabled && usageCounts.size() < values.size())
+		{
+			usageCounts.resize(values.size());
+		}
+
+		for (size_t position = 0; position < from.size(); position++)
+		{
+			P index = to[position];
+
+			values[index] = std::move(movedValues[position]);
+			assigned[index] = true;
+			referenceCounts[index] = movedReferences[position];
+
+			if (index < usageCounts.size())
+			{
+				usageCounts[index] = movedCounts[position];
+			}
+
+			if (from[position] != index)
+			{
+				remapping.add(primes[from[position]], primes[index]);
+			}
+		}
+
+		for (P index : from)
+		{
+			if (!assigned[index] && index < usageCounts.size())
+			{
+				usageCounts[index] = 0;
+			}
+		}
+
+		remapping.sort();
+
+		/*
+			The keys of the hash map are indices, so it is built again.
+		*/
+		primeMap.clear();
+
+		for (P index : to)
+		{
+			primeMap.emplace(ValueIndex{ index }, primes[index]);
+		}
+
+		numAddsSinceRerank = 0;
+
+		listeners.remap(remapping);
+
+		return remapping;
+	}
+
+	/**
+		The queue of holes returns the smallest index first.
+	*/
+	typedef std::priority_queue<P, std::vector<P>, std::greater<P>> HoleQueue;
+
+	/**
+		The primes are split into blocks of 2^blockShift numbers for finding the 
+		index of a prime.
+	*/
+	static const uint blockShift = 8;
+
+	/**
+		The key of a value in the hash map is the index of the value in the value
+		vector, which is also the index of its prime.
+	*/
+	struct ValueIndex
+	{
+		P index;
+	};
+
+	/**
+		This hashes a key by the value it refers to, so that the map can be searched
+		with a value, or anything that hashes like one, directly.
+	*/
+	struct ValueHash
+	{
+		typedef void is_transparent;
+
+		ValueHash(const std::vector<V>& values) : values(&values)
+		{
+		}
+
+		size_t operator()(const ValueIndex& key) const
+		{
+			return TransparentHash<V>()((*values)[key.index]);
+		}
+
+		template <typename Key>
+		size_t operator()(const Key& value) const
+		{
+			return TransparentHash<V>()(value);
+		}
+
+		const std::vector<V>* values;
+	};
+
+	/**
+		This compares a key with a value or another key. Keys are unique, so two keys
+		are equal if their indices are.
+	*/
+	struct ValueEqual
+	{
+		typedef void is_transparent;
+
+		ValueEqual(const std::vector<V>& values) : values(&values)
+		{
+		}
+
+		bool operator()(const ValueIndex& key, const ValueIndex& other) const
+		{
+			return key.index == other.index;
+		}
+
+		template <typename Key>
+		bool operator()(const ValueIndex& key, const Key& value) const
+		{
+			return (*values)[key.index] == value;
+		}
+
+		const std::vector<V>* values;
+	};
+
+	/**
+		The prime source calculates primes at runtime. It may be shared with other
+		tables.
+	*/
+	std::shared_ptr<PrimeSource<P, Store>> source;
+
+	/**
+		This calculates the next prime numbers to be added ahead of time on the 
+		producer thread of the source. It is declared after the source so that it is
+		destroyed, and stops its refills, before the source can be.
 	*/
-	std::future<uint> nextPrime;
+	PrimeLookahead<P, Store> lookahead;
 
 	/**
-		The sieve of eratosthenes is used to calculate primes at runtime.
+		The prime holes queue is used to store the indices of the primes that 
+		were once occupied but have since been deleted.
 	*/
-	SieveOfEratosthenes sieveOfEratosthenes;
+	HoleQueue primeHoles;
 
 	/**
-		The prime holes vector is used to store the primes that were once
-		occupied but have since been deleted.
+		This vector holds each value at the index of its prime. The values of 
+		deleted primes are reset until the prime is reassigned.
 	*/
-	std::priority_queue<uint> primeHoles;
+	std::vector<V> values;
 
 	/**
-		This map is used to assign a unique prime number to each value.
+		This marks the indices that are assigned to a value.
 	*/
-	std::unordered_map<V, uint> primeMap;
+	std::vector<bool> assigned;
 
-	/*
-		This map is used to lookup a value by its prime.
+	/**
+		This holds how many references bags hold to the value at each index.
+	*/
+	std::vector<uint> referenceCounts;
+
+	/**
+		This holds the index of the first prime of each block, up to the block of
+		the largest prime handed out.
+	*/
+	std::vector<P> blockIndices;
+
+	/**
+		This holds the inverse of the prime at each index for WordDivisor, up to the
+		largest prime handed out. The prime at an index never changes, so neither
+		does its inverse.
+	*/
+	std::vector<ulong> inverses;
+
+	/**
+		This holds how often the value at each index has been added, if reranking
+		is enabled.
+	*/
+	std::vector<uint64_t> usageCounts;
+
+	bool rerankingEnabled{ false };
+
+	/**
+		The number of adds after which the table reranks by itself, or 0.
+	*/
+	uint64_t rerankThreshold{ 0 };
+	uint64_t numAddsSinceRerank{ 0 };
+
+	/**
+		The listeners that are told about remappings, usually registered bags.
+	*/
+	PrimeRemapListenerList<P> listeners;
+
+	/**
+		This map is used to find the index and prime of a value. It is declared
+		after the value vector that its hash function refers to.
+	*/
+	typename MapPolicy::template map_type<ValueIndex, P, ValueHash, ValueEqual> primeMap;
+
+	/**
+		The counters of the table. They can be read from any thread.
 	*/
-	std::unordered_map<uint, V> reversePrimeMap;
+	StatisticsCounter numHits;
+	StatisticsCounter numMisses;
+	StatisticsCounter numHoleReuses;
+	StatisticsCounter numRemoves;
+	StatisticsCounter numRemappings;
 };
\ No newline at end of file
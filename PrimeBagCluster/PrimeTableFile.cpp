@@ -0,0 +1,436 @@
+#include "PrimeTableFile.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+typedef unsigned long long ulong;
+
+/**
+	The magic bytes at the start of every table file.
+*/
+static const char primeTableFileMagic[8] = { 'P', 'R', 'I', 'M', 'E', 'T', 'A', 'B' };
+
+/**
+	Returns the size of a section rounded up to a multiple of 8 bytes.
+*/
+static uint64_t padSection(uint64_t size)
+{
+	return (size + 7) & ~uint64_t(7);
+}
+
+PrimeTableFile::PrimeTableFile() : offsets(nullptr), holes(nullptr), slots(nullptr), arena(nullptr)
+{
+}
+
+std::shared_ptr<const PrimeTableFile> PrimeTableFile::open(const std::string& path, bool verifyChecksum)
+{
+	std::shared_ptr<PrimeTableFile> file(new PrimeTableFile());
+
+	file->mapping = MappedFile::open(path);
+
+	size_t size = file->mapping->getSize();
+
+	if (size < sizeof(PrimeTableFileHeader))
+	{
+		throw std::runtime_error("Table file " + path + " is truncated");
+	}
+
+	/*
+		Validate the header before anything else is read.
+	*/
+	const PrimeTableFileHeader& header = file->getHeader();
+
+	if (memcmp(header.magic, primeTableFileMagic, sizeof(primeTableFileMagic)) || header.version != currentVersion)
+	{
+		throw std::runtime_error("Unknown table file format in " + path);
+	}
+
+	if (header.wordSize != sizeof(uint32_t) && header.wordSize != sizeof(uint64_t))
+	{
+		throw std::runtime_error("Table file " + path + " has an unsupported word size");
+	}
+
+	if (!header.numSlots || (header.numSlots & (header.numSlots - 1)) || header.numHoles > header.numIndices)
+	{
+		throw std::runtime_error("Table file " + path + " is corrupt");
+	}
+
+	/*
+		The counts are checked against the file size one section at a time, so that
+		none of the sums can overflow.
+	*/
+	uint64_t remaining = size - sizeof(PrimeTableFileHeader);
+
+	if (header.numIndices >= remaining / sizeof(uint64_t) ||
+		header.numHoles > remaining / header.wordSize || header.numSlots > remaining / header.wordSize)
+	{
+		throw std::runtime_error("Table file " + path + " is truncated");
+	}
+
+	uint64_t offsetsSize = (header.numIndices + 1) * sizeof(uint64_t);
+	uint64_t holesSize = padSection(header.numHoles * header.wordSize);
+	uint64_t slotsSize = padSection(header.numSlots * header.wordSize);
+
+	if (offsetsSize + holesSize + slotsSize > remaining || remaining - offsetsSize - holesSize - slotsSize != header.arenaSize)
+	{
+		throw std::runtime_error("Table file " + path + " is truncated");
+	}
+
+	const char* data = static_cast<const char*>(file->mapping->getData()) + sizeof(PrimeTableFileHeader);
+
+	file->offsets = reinterpret_cast<const uint64_t*>(data);
+	file->holes = data + offsetsSize;
+	file->slots = file->holes + holesSize;
+	file->arena = file->slots + slotsSize;
+
+	/*
+		Verifying reads the whole file anyway, so the sections are checked for
+		consistency as well. Otherwise only the words that are read are checked, as
+		they are read.
+	*/
+	if (verifyChecksum && (hashBytes(data, size_t(remaining)) != header.checksum || !file->hasValidSections()))
+	{
+		throw std::runtime_error("Table file " + path + " is corrupt");
+	}
+
+	return file;
+}
+
+bool PrimeTableFile::hasValidSections() const
+{
+	const PrimeTableFileHeader& header = getHeader();
+	size_t numIndices = size_t(header.numIndices);
+
+	/*
+		The value at each index lies within the arena.
+	*/
+	if (offsets[numIndices] != header.arenaSize)
+	{
+		return false;
+	}
+
+	for (size_t index = 0; index < numIndices; index++)
+	{
+		if (offsets[index] > offsets[index + 1])
+		{
+			return false;
+		}
+	}
+
+	/*
+		The holes are distinct indices in ascending order. The holes are marked so
+		that slots pointing at them, or at an index twice, are found below.
+	*/
+	std::vector<bool> seen(numIndices);
+
+	for (size_t hole = 0; hole < getNumHoles(); hole++)
+	{
+		uint64_t index = getWord(holes, hole);
+
+		if (index >= numIndices || (hole && index <= getWord(holes, hole - 1)))
+		{
+			return false;
+		}
+
+		seen[size_t(index)] = true;
+	}
+
+	/*
+		Every value is in exactly one slot. A lookup of a missing value stops at the
+		first empty slot, so there has to be one.
+	*/
+	size_t numFilledSlots = 0;
+
+	for (size_t position = 0; position < header.numSlots; position++)
+	{
+		uint64_t slot = getWord(slots, position);
+
+		if (!slot)
+		{
+			continue;
+		}
+
+		if (slot > numIndices || seen[size_t(slot - 1)])
+		{
+			return false;
+		}
+
+		seen[size_t(slot - 1)] = true;
+		numFilledSlots++;
+	}
+
+	return numFilledSlots == getNumValues() && numFilledSlots < header.numSlots;
+}
+
+void PrimeTableFile::write(const std::string& path, uint32_t wordSize, ulong lastPrime,
+	const std::vector<uint64_t>& offsets, const std::vector<bool>& assigned, const std::string& arena)
+{
+	std::vector<uint64_t> holes;
+	size_t numValues = 0;
+
+	for (size_t index = 0; index < assigned.size(); index++)
+	{
+		if (assigned[index])
+		{
+			numValues++;
+		}
+		else
+		{
+			holes.push_back(index);
+		}
+	}
+
+	/*
+		The value index is at most half full, so that probes stay short.
+	*/
+	uint64_t numSlots = 1;
+
+	while (numSlots < 2 * numValues)
+	{
+		numSlots *= 2;
+	}
+
+	std::vector<uint64_t> slots(size_t(numSlots), 0);
+
+	for (size_t index = 0; index < assigned.size(); index++)
+	{
+		if (assigned[index])
+		{
+			uint64_t position = hashBytes(arena.data() + offsets[index], size_t(offsets[index + 1] - offsets[index])) & (numSlots - 1);
+
+			while (slots[size_t(position)])
+			{
+				position = (position + 1) & (numSlots - 1);
+			}
+
+			slots[size_t(position)] = index + 1;
+		}
+	}
+
+	PrimeTableFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, primeTableFileMagic, sizeof(primeTableFileMagic));
+
+	header.version = currentVersion;
+	header.wordSize = wordSize;
+	header.numIndices = assigned.size();
+	header.numHoles = holes.size();
+	header.numSlots = numSlots;
+	header.arenaSize = arena.size();
+	header.lastPrime = lastPrime;
+
+	/*
+		The file is written next to the path and renamed over it once it is complete,
+		so that a failed write leaves the old file as it was.
+	*/
+	std::string temporaryPath = path + ".tmp";
+	std::ofstream stream(temporaryPath, std::ios::binary | std::ios::trunc);
+
+	/*
+		The sections are written while the checksum is calculated, and the header is
+		written again once the checksum is known.
+	*/
+	stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	uint64_t hash = hashBytes(nullptr, 0);
+
+	auto writeBytes = [&](const char* bytes, size_t size)
+	{
+		hash = hashBytes(bytes, size, hash);
+		stream.write(bytes, std::streamsize(size));
+	};
+
+	auto writeWords = [&](const std::vector<uint64_t>& words)
+	{
+		std::vector<char> section(size_t(padSection(words.size() * wordSize)), 0);
+
+		for (size_t position = 0; position < words.size(); position++)
+		{
+			if (wordSize == sizeof(uint32_t))
+			{
+				uint32_t word = uint32_t(words[position]);
+				memcpy(&section[position * wordSize], &word, sizeof(word));
+			}
+			else
+			{
+				memcpy(&section[position * wordSize], &words[position], sizeof(uint64_t));
+			}
+		}
+
+		writeBytes(section.data(), section.size());
+	};
+
+	writeBytes(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+	writeWords(holes);
+	writeWords(slots);
+	writeBytes(arena.data(), arena.size());
+
+	header.checksum = hash;
+
+	stream.seekp(0);
+	stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	stream.flush();
+
+	bool written = bool(stream);
+	stream.close();
+
+	if (!written || stream.fail())
+	{
+		std::remove(temporaryPath.c_str());
+		throw std::runtime_error("Could not write table file " + path);
+	}
+
+#ifdef _WIN32
+	bool renamed = MoveFileExA(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	bool renamed = std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+#endif
+
+	if (!renamed)
+	{
+		std::remove(temporaryPath.c_str());
+		throw std::runtime_error("Could not replace table file " + path);
+	}
+}
+
+size_t PrimeTableFile::findIndex(std::string_view bytes) const
+{
+	const PrimeTableFileHeader& header = getHeader();
+	uint64_t position = hashBytes(bytes.data(), bytes.size()) & (header.numSlots - 1);
+
+	/*
+		A file without an empty slot would probe forever, so a lookup gives up once
+		it has seen every slot.
+	*/
+	for (uint64_t probe = 0; probe < header.numSlots; probe++, position = (position + 1) & (header.numSlots - 1))
+	{
+		uint64_t slot = getWord(slots, size_t(position));
+
+		if (!slot)
+		{
+			break;
+		}
+
+		if (slot > header.numIndices)
+		{
+			throw std::runtime_error("Table file has a slot past its indices");
+		}
+
+		if (getValueBytes(size_t(slot - 1)) == bytes)
+		{
+			return size_t(slot - 1);
+		}
+	}
+
+	return size_t(header.numIndices);
+}
+
+std::string_view PrimeTableFile::getValueBytes(size_t index) const
+{
+	if (index >= getNumIndices() || offsets[index] > offsets[index + 1] || offsets[index + 1] > getHeader().arenaSize)
+	{
+		throw std::runtime_error("Table file has a value outside of its arena");
+	}
+
+	return std::string_view(arena + offsets[index], size_t(offsets[index + 1] - offsets[index]));
+}
+
+bool PrimeTableFile::containsIndex(size_t index) const
+{
+	if (index >= getNumIndices())
+	{
+		return false;
+	}
+
+	/*
+		Binary search the holes for the index.
+	*/
+	size_t first = 0;
+	size_t last = getNumHoles();
+
+	while (first < last)
+	{
+		size_t middle = first + (last - first) / 2;
+
+		if (getHole(middle) < index)
+		{
+			first = middle + 1;
+		}
+		else
+		{
+			last = middle;
+		}
+	}
+
+	return first == getNumHoles() || getHole(first) != index;
+}
+
+uint32_t PrimeTableFile::getWordSize() const
+{
+	return getHeader().wordSize;
+}
+
+size_t PrimeTableFile::getNumIndices() const
+{
+	return size_t(getHeader().numIndices);
+}
+
+size_t PrimeTableFile::getNumValues() const
+{
+	return size_t(getHeader().numIndices - getHeader().numHoles);
+}
+
+size_t PrimeTableFile::getNumHoles() const
+{
+	return size_t(getHeader().numHoles);
+}
+
+size_t PrimeTableFile::getHole(size_t hole) const
+{
+	uint64_t index = getWord(holes, hole);
+
+	if (index >= getHeader().numIndices)
+	{
+		throw std::runtime_error("Table file has a hole past its indices");
+	}
+
+	return size_t(index);
+}
+
+ulong PrimeTableFile::getLastPrime() const
+{
+	return getHeader().lastPrime;
+}
+
+uint64_t PrimeTableFile::hashBytes(const char* bytes, size_t size, uint64_t hash)
+{
+	for (size_t position = 0; position < size; position++)
+	{
+		hash ^= uint8_t(bytes[position]);
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+const PrimeTableFileHeader& PrimeTableFile::getHeader() const
+{
+	return *static_cast<const PrimeTableFileHeader*>(mapping->getData());
+}
+
+uint64_t PrimeTableFile::getWord(const char* section, size_t position) const
+{
+	if (getHeader().wordSize == sizeof(uint32_t))
+	{
+		return reinterpret_cast<const uint32_t*>(section)[position];
+	}
+
+	return reinterpret_cast<const uint64_t*>(section)[position];
+}
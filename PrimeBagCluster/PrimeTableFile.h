@@ -0,0 +1,194 @@
+#pragma once
+
+#include "MappedFile.h"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+typedef unsigned long long ulong;
+
+/**
+	This is the header at the start of every table file. It is followed by these
+	sections, each starting at a multiple of 8 bytes:
+
+	- numIndices + 1 offsets into the value arena, as 64-bit words. The bytes of the
+	  value at an index run from its offset to the next one.
+	- The numHoles unassigned indices below numIndices in ascending order, as words
+	  of wordSize bytes.
+	- The numSlots slots of an open addressing index from the bytes of a value to
+	  its index, as words of wordSize bytes. A slot holds 1 more than the index of a
+	  value, or 0 if it is empty.
+	- The value arena of arenaSize bytes.
+*/
+struct PrimeTableFileHeader
+{
+	/**
+		Always "PRIMETAB".
+	*/
+	char magic[8];
+
+	/**
+		The version of the file format. Files with a different version are rejected.
+	*/
+	uint32_t version;
+
+	/**
+		The size in bytes of the prime type of the table, either 4 or 8.
+	*/
+	uint32_t wordSize;
+
+	/**
+		The number of primes the table had handed out, including the holes. The table
+		continues with the prime at this index.
+	*/
+	uint64_t numIndices;
+
+	uint64_t numHoles;
+
+	/**
+		The number of slots of the value index, which is a power of two.
+	*/
+	uint64_t numSlots;
+
+	uint64_t arenaSize;
+
+	/**
+		The prime at index numIndices - 1, or 0 if the table was empty. A table is
+		only restored on a prime source that agrees with it.
+	*/
+	uint64_t lastPrime;
+
+	/**
+		A 64-bit FNV-1a hash of every byte after the header.
+	*/
+	uint64_t checksum;
+};
+
+/**
+	A PrimeTableFile is a read-only memory mapping of a snapshot of a PrimeTable. It
+	holds the values at the indices of their primes, the holes left by removed values
+	and an index from values to primes, so the table can be queried in place and the
+	primes of the values are the same as when it was saved.
+
+	Opening a table file only checks the header against the file size, and pages
+	are read as they are used. Every offset, hole and slot is checked against the
+	bounds of its section when it is read, so a corrupt file throws rather than 
+	reads outside the mapping. Verifying the checksum reads the whole file, and 
+	then also checks that the offsets, holes and index agree with each other. The
+	values are stored as bytes by a ValueCodec, and PrimeTableView reads them as
+	values.
+*/
+class PrimeTableFile
+{
+public:
+	/**
+		The version of the file format written by this class.
+	*/
+	static const uint32_t currentVersion = 1;
+
+	/**
+		Maps a table file into memory. Throws std::runtime_error if the file cannot be
+		mapped, has an unknown format or its sections do not fit the file. Unless 
+		verifyChecksum is false, the whole file is read to verify the checksum and 
+		that the sections are consistent.
+	*/
+	static std::shared_ptr<const PrimeTableFile> open(const std::string& path, bool verifyChecksum = true);
+
+	/**
+		Writes a new table file. The value at each index of assigned that is set is
+		stored as the bytes of arena from its offset to the next one, so there is one
+		more offset than indices. The file is written to the path with ".tmp" appended
+		and then renamed over the path, so an existing file is only replaced by a 
+		complete one. Throws std::runtime_error if the file cannot be written or 
+		renamed. On Windows, the path must not be a file that is currently mapped.
+	*/
+	static void write(const std::string& path, uint32_t wordSize, ulong lastPrime,
+		const std::vector<uint64_t>& offsets, const std::vector<bool>& assigned, const std::string& arena);
+
+	PrimeTableFile(const PrimeTableFile&) = delete;
+	PrimeTableFile& operator=(const PrimeTableFile&) = delete;
+
+	/**
+		Returns the index of the value with the given bytes, or the number of indices
+		if there is no such value. Throws std::runtime_error if a slot it probes is
+		past the indices.
+	*/
+	size_t findIndex(std::string_view bytes) const;
+
+	/**
+		Returns the bytes of the value at an index, which must be assigned. Throws 
+		std::runtime_error if the offsets of the value are not within the arena.
+	*/
+	std::string_view getValueBytes(size_t index) const;
+
+	/**
+		Returns whether or not the index is assigned to a value.
+	*/
+	bool containsIndex(size_t index) const;
+
+	/**
+		Returns the size in bytes of the prime type of the table.
+	*/
+	uint32_t getWordSize() const;
+
+	/**
+		Returns the number of primes the table had handed out, including the holes.
+	*/
+	size_t getNumIndices() const;
+
+	/**
+		Returns the number of values in the table.
+	*/
+	size_t getNumValues() const;
+
+	size_t getNumHoles() const;
+
+	/**
+		Returns an unassigned index. The holes are in ascending order. Throws 
+		std::runtime_error if the hole is past the indices.
+	*/
+	size_t getHole(size_t hole) const;
+
+	/**
+		Returns the prime at the last index, or 0 if the table was empty.
+	*/
+	ulong getLastPrime() const;
+
+private:
+	PrimeTableFile();
+
+	/**
+		Returns the 64-bit FNV-1a hash of a range of bytes, continued from hash.
+	*/
+	static uint64_t hashBytes(const char* bytes, size_t size, uint64_t hash = 14695981039346656037ull);
+
+	const PrimeTableFileHeader& getHeader() const;
+
+	/**
+		Returns whether the offsets are ascending up to the arena size, the holes are
+		ascending indices, and the slots hold every value once and at least one empty
+		slot.
+	*/
+	bool hasValidSections() const;
+
+	/**
+		Returns the word at a position of a section of wordSize words.
+	*/
+	uint64_t getWord(const char* section, size_t position) const;
+
+	/**
+		The mapping of the whole file.
+	*/
+	std::shared_ptr<const MappedFile> mapping;
+
+	/**
+		The start of each section in the mapping.
+	*/
+	const uint64_t* offsets;
+	const char* holes;
+	const char* slots;
+	const char* arena;
+};
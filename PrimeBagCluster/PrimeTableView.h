@@ -0,0 +1,234 @@
+#pragma once
+
+#include "PrimeSource.h"
+#include "PrimeTableFile.h"
+#include "ValueCodec.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+
+/**
+	A PrimeTableView answers the queries of a PrimeTable straight from a mapped
+	PrimeTableFile, without reading the whole snapshot first. A saved vocabulary is
+	queryable as soon as the file is mapped. A lookup only makes the prime source
+	calculate the primes it needs, and the last prime the table had handed out is
+	compared with the file once the source has calculated it, which is immediate
+	for a source on a PrimeFile. A view is read-only. A PrimeTable restored from it
+	loads every value, and can change.
+
+	Values are looked up by their bytes under ValueCodec<V>, so any key that the
+	codec accepts can be used without constructing a V. getValue decodes a copy of
+	the value.
+
+	The type parameters are those of PrimeTable.
+*/
+template <typename V, typename P = uint32_t, typename Store = PrimeStore<P>>
+class PrimeTableView
+{
+public:
+	/**
+		This constructor creates a view of a table file on a prime source, by default
+		the process-wide one. Throws std::runtime_error if the file stores primes of
+		a different word size, or if the source has already calculated the primes the
+		table had handed out and they are not those the file was written with. A
+		source that has not calculated them yet is checked by the first lookup that
+		needs them, which throws instead.
+	*/
+	PrimeTableView(std::shared_ptr<const PrimeTableFile> file, std::shared_ptr<PrimeSource<P, Store>> source = PrimeSource<P, Store>::getShared())
+		: file(file), source(source)
+	{
+		if (file->getWordSize() != sizeof(P))
+		{
+			throw std::runtime_error("The table file stores primes of a different word size.");
+		}
+
+		checkLastPrime();
+	}
+
+	PrimeTableView(const PrimeTableView<V, P, Store>& view)
+		: file(view.file), source(view.source), checkedLastPrime(view.checkedLastPrime.load())
+	{
+	}
+
+	PrimeTableView<V, P, Store>& operator=(const PrimeTableView<V, P, Store>& view)
+	{
+		file = view.file;
+		source = view.source;
+		checkedLastPrime = view.checkedLastPrime.load();
+
+		return *this;
+	}
+
+	/**
+		Returns the prime number associated with a value. Returns 0 if it could not be
+		found.
+	*/
+	template <typename Key>
+	P getPrime(const Key& value) const
+	{
+		size_t index = file->findIndex(ValueCodec<V>::encode(value));
+
+		return index < file->getNumIndices() ? getPrimes(index + 1)[index] : 0;
+	}
+
+	/**
+		Returns a copy of the value associated with a given prime number. Throws 
+		std::out_of_range if the given prime is not assigned to a value.
+	*/
+	V getValue(P prime) const
+	{
+		return getValueAt(getPrimeIndex(prime));
+	}
+
+	/**
+		Returns a copy of the value associated with the prime at an index into the list
+		of prime numbers. Throws std::out_of_range if that prime is not assigned to a
+		value.
+	*/
+	V getValueAt(size_t index) const
+	{
+		if (!file->containsIndex(index))
+		{
+			throw std::out_of_range("The prime is not assigned to a value.");
+		}
+
+		return ValueCodec<V>::decode(file->getValueBytes(index));
+	}
+
+	bool containsPrime(P prime) const
+	{
+		return file->containsIndex(getPrimeIndex(prime));
+	}
+
+	bool containsIndex(size_t index) const
+	{
+		return file->containsIndex(index);
+	}
+
+	/**
+		Returns the index of a prime number into the list of prime numbers. Only the
+		primes the table had handed out are searched, and the number of those is 
+		returned if the given number is not one of them. Those primes are only all
+		calculated if the given number is larger than the ones that already are.
+	*/
+	size_t getPrimeIndex(P prime) const
+	{
+		size_t end = file->getNumIndices();
+		const Store& calculated = source->getCalculatedPrimes();
+		size_t numCalculated = calculated.size();
+
+		/*
+			The table's primes are a prefix of the calculated ones, so a number within
+			the calculated primes is found among them or not at all.
+		*/
+		size_t searchEnd = numCalculated && calculated[numCalculated - 1] >= prime ? std::min(end, numCalculated) : end;
+		const Store& primes = getPrimes(searchEnd);
+
+		/*
+			The stores only guarantee fast indexing, so this is a binary search by
+			index rather than std::lower_bound.
+		*/
+		size_t first = 0;
+		size_t last = searchEnd;
+
+		while (first < last)
+		{
+			size_t middle = first + (last - first) / 2;
+
+			if (primes[middle] < prime)
+			{
+				first = middle + 1;
+			}
+			else
+			{
+				last = middle;
+			}
+		}
+
+		return first < searchEnd && primes[first] == prime ? first : end;
+	}
+
+	/**
+		Returns the primes of the source, once it has calculated every prime the table
+		had handed out and they have been checked against the file. Throws 
+		std::runtime_error if the file was written with other primes.
+	*/
+	const Store& getPrimeNumbers() const
+	{
+		return getPrimes(file->getNumIndices());
+	}
+
+	/**
+		Returns the number of values in the table.
+	*/
+	size_t size() const
+	{
+		return file->getNumValues();
+	}
+
+	std::shared_ptr<const PrimeTableFile> getFile() const
+	{
+		return file;
+	}
+
+	std::shared_ptr<PrimeSource<P, Store>> getPrimeSource() const
+	{
+		return source;
+	}
+
+private:
+	/**
+		Returns the primes of the source after calculating at least the given number
+		of them, and checks the last prime of the table once they include it.
+	*/
+	const Store& getPrimes(size_t numPrimes) const
+	{
+		if (numPrimes && source->getCalculatedPrimes().size() < numPrimes)
+		{
+			source->getPrimeNumber(numPrimes - 1);
+		}
+
+		if (!checkedLastPrime.load(std::memory_order_acquire))
+		{
+			checkLastPrime();
+		}
+
+		return source->getCalculatedPrimes();
+	}
+
+	/**
+		Compares the last prime the table had handed out with the file if the source
+		has calculated it already, and remembers that it matched. Throws 
+		std::runtime_error if it does not.
+	*/
+	void checkLastPrime() const
+	{
+		size_t numIndices = file->getNumIndices();
+		const Store& primes = source->getCalculatedPrimes();
+
+		if (numIndices && primes.size() < numIndices)
+		{
+			return;
+		}
+
+		if (numIndices && primes[numIndices - 1] != file->getLastPrime())
+		{
+			throw std::runtime_error("The table file was written with other primes than those of the source.");
+		}
+
+		checkedLastPrime.store(true, std::memory_order_release);
+	}
+
+	std::shared_ptr<const PrimeTableFile> file;
+
+	std::shared_ptr<PrimeSource<P, Store>> source;
+
+	/**
+		This is set once the last prime of the table has been compared with the file.
+		It is set by const lookups, which may run on several threads.
+	*/
+	mutable std::atomic<bool> checkedLastPrime{ false };
+};
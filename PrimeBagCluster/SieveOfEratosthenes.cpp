@@ -1,112 +1,335 @@
 #include "SieveOfEratosthenes.h"
 
+#include <cmath>
+#include <atomic>
+#include <future>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
 typedef unsigned int uint;
 typedef unsigned long long ulong;
 
-SieveOfEratosthenes::SieveOfEratosthenes(const std::vector<uint>* primeNumbers = nullptr)
+/**
+	The number of consecutive segments each thread claims at a time during a parallel
+	sieve pass.
+*/
+static const uint parallelChunkSegments = 8;
+
+/**
+	The highest number a sieve of prime type P will test. This is the largest value of
+	P, but for 64-bit primes it stays far enough below 2^64 that the end of a segment or
+	chunk can never overflow.
+*/
+template <typename P>
+static ulong maxSieveNumber()
+{
+	return std::min<ulong>(std::numeric_limits<P>::max(), std::numeric_limits<ulong>::max() - (ulong(1) << 40));
+}
+
+template <typename P, typename Store>
+SieveOfEratosthenes<P, Store>::SieveOfEratosthenes(const std::vector<P>* primeNumbers)
+	: numSievingPrimes(0), segmentSieve(2)
 {
 	/*
 		We know 0 and 1 are composite numbers. These can be considered tested.
 	*/
 	highestTestedNum = 1;
-	sieveLimit = 1;
+
+	setNumThreads(0);
 
 	/*
-		If a pointer to a prime number vector has been provided, iterate through it
+		If a pointer to a prime number vector has been provided, copy it
 	*/
-	if (primeNumbers)
+	if (primeNumbers && !primeNumbers->empty())
 	{
-		for (uint i : *primeNumbers)
-		{
-			/*
-				Copy each prime number.
-			*/
-			primes.push_back(i);
-		}
+		primes.append(primeNumbers->begin(), primeNumbers->end());
 
 		/*
 			We have tested all numbers up the final number in the primes vector.
 		*/
 		highestTestedNum = primes.back();
-		sieveLimit = highestTestedNum;
+
+		segmentSieve.seek(ulong(highestTestedNum) + 1);
 	}
 }
 
-const std::vector<uint>& SieveOfEratosthenes::getCalculatedPrimes() const
+template <typename P, typename Store>
+SieveOfEratosthenes<P, Store>::SieveOfEratosthenes(std::shared_ptr<const PrimeFile> primeFile)
+	: primes(primeFile), numSievingPrimes(0), segmentSieve(primeFile->getHighestTestedNum() + 1)
+{
+	highestTestedNum = primeFile->getHighestTestedNum();
+
+	setNumThreads(0);
+}
+
+template <typename P, typename Store>
+void SieveOfEratosthenes<P, Store>::save(const std::string& path) const
+{
+	PrimeFile::write(path, primes, highestTestedNum);
+}
+
+template <typename P, typename Store>
+const Store& SieveOfEratosthenes<P, Store>::getCalculatedPrimes() const
 {
 	return primes;
 }
 
-size_t SieveOfEratosthenes::getNumCalculatedPrimes() const
+template <typename P, typename Store>
+size_t SieveOfEratosthenes<P, Store>::getNumCalculatedPrimes() const
 {
 	return primes.size();
 }
 
-uint SieveOfEratosthenes::getPrimeNumber(size_t index)
+template <typename P, typename Store>
+P SieveOfEratosthenes<P, Store>::getPrimeNumber(size_t index)
 {
 	sieve(index + 1);
 
 	return primes[index];
 }
 
-void SieveOfEratosthenes::sieve(size_t numPrimes)
+template <typename P, typename Store>
+void SieveOfEratosthenes<P, Store>::setNumThreads(uint threads)
 {
+	numThreads = threads ? threads : std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+template <typename P, typename Store>
+uint SieveOfEratosthenes<P, Store>::getNumThreads() const
+{
+	return numThreads;
+}
+
+template <typename P, typename Store>
+SieveStatistics SieveOfEratosthenes<P, Store>::getStatistics() const
+{
+	SieveStatistics statistics;
+	statistics.numPasses = numPasses.load();
+	statistics.numSegments = numSegments.load();
+	statistics.numParallelPasses = numParallelPasses.load();
+	statistics.numPrimes = primes.size();
+	statistics.passNanoseconds = passNanoseconds.snapshot();
+
+	return statistics;
+}
+
+template <typename P, typename Store>
+ulong SieveOfEratosthenes<P, Store>::nthPrimeUpperBound(size_t n)
+{
+	static const ulong smallPrimes[6] = { 2, 2, 3, 5, 7, 11 };
+
+	if (n < 6)
+	{
+		return smallPrimes[n];
+	}
+
+	double logN = log(double(n)), logLogN = log(logN);
+	double bound = n * (logN + logLogN);
+
+	if (n >= 688383)
+	{
+		bound = n * (logN + logLogN - 1 + (logLogN - 2) / logN);
+	}
+
 	/*
-		Run until all the necessary primes are calculated.
+		Round up generously so that floating point error can never put the bound 
+		below the prime.
 	*/
-	while (primes.size() < numPrimes)
+	return ulong(bound) + 2;
+}
+
+template <typename P, typename Store>
+size_t SieveOfEratosthenes<P, Store>::primeCountUpperBound(ulong x)
+{
+	if (x < 2)
 	{
-		/*
-			Lower bound of this segment.
-		*/
-		uint min = highestTestedNum + 1;
+		return 0;
+	}
 
-		/*
-			Update the limit on this sieve of eratosthenes if needed.
-		*/
-		while (sieveLimit <= min)
+	double logX = log(double(x));
+
+	return size_t(x / logX * (1 + 1.2762 / logX)) + 1;
+}
+
+template <typename P, typename Store>
+void SieveOfEratosthenes<P, Store>::sieve(size_t numPrimes)
+{
+	if (primes.size() >= numPrimes)
+	{
+		return;
+	}
+
+	StatisticsTimer timer;
+
+	/*
+		The last prime needed is at most limit. If the rest of the range up to the 
+		limit spans enough segments to keep every thread busy, all of it is sieved in 
+		one parallel pass.
+	*/
+	ulong limit = std::min(nthPrimeUpperBound(numPrimes), maxSieveNumber<P>());
+	ulong chunkNumbers = parallelChunkSegments * segmentSieve.getSegmentNumbers();
+	bool parallel = numThreads > 1 && limit / chunkNumbers >= segmentSieve.getNextNumber() / chunkNumbers + numThreads;
+
+	/*
+		Sieving stops at the end of a segment or chunk, so the number of primes up to 
+		limit plus one of those bounds the size of the primes vector. Small requests 
+		still grow the vector geometrically so that repeated calls do not reallocate 
+		every time.
+	*/
+	size_t estimate = primeCountUpperBound(limit + (parallel ? chunkNumbers : segmentSieve.getSegmentNumbers()));
+
+	if (estimate > primes.capacity())
+	{
+		primes.reserve(std::max(estimate, primes.capacity() + primes.capacity() / 2));
+	}
+
+	/*
+		The parallel chunks need every prime up to sqrt(limit) before they start, so
+		those are sieved here first.
+	*/
+	if (parallel)
+	{
+		ulong root = ulong(sqrt(double(limit))) + 1;
+
+		while (highestTestedNum < root)
 		{
-			sieveLimit *= 2;
+			sieveNextSegment();
 		}
 
-		/*
-			Dimensions of the bit field
-		*/
-		uint root = uint(sqrt(sieveLimit)), max = std::min(sieveLimit, min + root);
-
-		/*
-			This bit field is used to represent the primality of each number
-			in this segment. Initially, all numbers will be considered prime.
-			The composite numbers will be sieved out.
-		*/
-		std::vector<bool> bitField(max - min + 1);
-		std::fill(bitField.begin(), bitField.end(), true);
+		if (primes.size() < numPrimes)
+		{
+			sieveParallel(segmentSieve.getNextNumber(), limit);
+		}
+	}
 
+	/*
+		Run until all the necessary primes are calculated.
+	*/
+	while (primes.size() < numPrimes)
+	{
 		/*
-			Sieve out the multiples of each calculated prime number.
+			Stop once every number that fits in the prime type has been tested.
 		*/
-		for (uint prime : primes)
+		if (highestTestedNum >= maxSieveNumber<P>())
 		{
-			countMultiplesInBitField(bitField, prime, min, max);
+			throw std::overflow_error("The requested prime number does not fit in the prime type.");
 		}
 
-		for (uint index = 0; index < bitField.size(); index++)
+		sieveNextSegment();
+	}
+
+	numPasses.add();
+	passNanoseconds.record(timer.getNanoseconds());
+}
+
+template <typename P, typename Store>
+void SieveOfEratosthenes<P, Store>::sieveNextSegment()
+{
+	addSievingPrimes(segmentSieve, numSievingPrimes);
+
+	segmentPrimes.clear();
+	segmentSieve.sieveNextSegment(segmentPrimes, maxSieveNumber<P>());
+	primes.append(segmentPrimes.begin(), segmentPrimes.end());
+	numSegments.add();
+
+	/*
+		We have now tested up to the upper bound of this segment.
+	*/
+	highestTestedNum = segmentSieve.getNextNumber() - 1;
+}
+
+template <typename P, typename Store>
+void SieveOfEratosthenes<P, Store>::sieveParallel(ulong min, ulong max)
+{
+	/*
+		The range is split into chunks of whole segments on the same grid as the
+		serial segments, so that no two chunks share a wheel byte.
+	*/
+	ulong firstBase = min - min % 30;
+	ulong chunkNumbers = parallelChunkSegments * segmentSieve.getSegmentNumbers();
+	size_t numChunks = size_t((max - firstBase) / chunkNumbers + 1);
+
+	std::vector<std::vector<P>> results(numChunks);
+	std::atomic<size_t> nextChunk{ 0 };
+
+	/*
+		Each worker claims the next unsieved chunk until there are none left. Every
+		chunk gets its own segment engine, which carries the next multiples of its 
+		sieving primes from one segment of the chunk to the next. The primes vector 
+		is only read while the workers are running.
+	*/
+	auto worker = [&]()
+	{
+		for (size_t index = nextChunk++; index < numChunks; index = nextChunk++)
 		{
-			if (bitField[index])
+			WheelSegmentSieve chunkSieve(std::max(min, firstBase + index * chunkNumbers), segmentSieve.getSegmentNumbers() / 30);
+			size_t chunkSievingPrimes = 0;
+
+			for (uint segment = 0; segment < parallelChunkSegments; segment++)
 			{
-				/*
-					Sieve out the mulitples of this prime number and then push
-					it onto the back of the prime number vector.
-				*/
-				uint prime = index + min;
-				countMultiplesInBitField(bitField, prime, min, max);
-				primes.push_back(prime);
+				addSievingPrimes(chunkSieve, chunkSievingPrimes);
+				chunkSieve.sieveNextSegment(results[index], maxSieveNumber<P>());
 			}
 		}
+	};
 
-		/*
-			We have now tested up to the upper bound of this segment.
-		*/
-		highestTestedNum = max;
+	std::vector<std::future<void>> workers;
+
+	for (uint thread = 1; thread < numThreads; thread++)
+	{
+		workers.push_back(std::async(std::launch::async, worker));
+	}
+
+	worker();
+
+	for (std::future<void>& future : workers)
+	{
+		future.get();
+	}
+
+	/*
+		Merge the chunks onto the back of the prime number vector in order.
+	*/
+	size_t numFound = 0;
+
+	for (const std::vector<P>& result : results)
+	{
+		numFound += result.size();
+	}
+
+	primes.reserve(primes.size() + numFound);
+
+	for (const std::vector<P>& result : results)
+	{
+		primes.append(result.begin(), result.end());
+	}
+
+	/*
+		The serial segments continue where the last chunk ended.
+	*/
+	ulong next = firstBase + numChunks * chunkNumbers;
+
+	highestTestedNum = next - 1;
+	segmentSieve.seek(next);
+	numParallelPasses.add();
+}
+
+template <typename P, typename Store>
+void SieveOfEratosthenes<P, Store>::addSievingPrimes(WheelSegmentSieve& engine, size_t& index) const
+{
+	ulong end = engine.getSegmentEnd();
+
+	/*
+		Sieving primes are below 2^32 since no segment end reaches 2^64.
+	*/
+	for (; index < primes.size() && primes[index] <= 0xFFFFFFFFu && ulong(primes[index]) * primes[index] < end; index++)
+	{
+		engine.addSievingPrime(uint(primes[index]));
 	}
-}
\ No newline at end of file
+}
+
+template class SieveOfEratosthenes<uint32_t, PrimeStore<uint32_t>>;
+template class SieveOfEratosthenes<uint64_t, PrimeStore<uint64_t>>;
+template class SieveOfEratosthenes<uint32_t, CompactPrimeStore<uint32_t>>;
+template class SieveOfEratosthenes<uint64_t, CompactPrimeStore<uint64_t>>;
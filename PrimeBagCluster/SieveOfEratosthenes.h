@@ -1,40 +1,45 @@
 #pragma once
 
+#include "WheelSegmentSieve.h"
+#include "PrimeStore.h"
+#include "CompactPrimeStore.h"
+#include "PrimeFile.h"
+#include "Statistics.h"
 #include <vector>
+#include <memory>
+#include <string>
+#include <cstddef>
+#include <cstdint>
 
 typedef unsigned long long ulong;
 typedef unsigned int uint;
 
 /**
-	This helper function is used to mark off composite numbers from a bit field given a
-	prime number and the range of numbers to iterate through.
+	These are the statistics of a SieveOfEratosthenes. A pass is a request for primes
+	that had to sieve further. It sieves serial segments and at most one large range
+	in parallel, and its time includes both.
 */
-static void countMultiplesInBitField(std::vector<bool>& bitField, uint prime, uint min, uint max)
+struct SieveStatistics
 {
-	/*
-		We only need to loop from prime ^ 2 to the max bound.
-		All other multiples will be found from other primes.
-	*/
-	ulong square = ulong(prime) * prime;
-
-	for (ulong multiple = square; multiple <= max; multiple += prime)
-	{
-		if (multiple >= min)
-		{
-			/*
-				Mark the multiples as composite.
-			*/
-			bitField[multiple - min] = false;
-		}
-	}
+	uint64_t numPasses;
+	uint64_t numSegments;
+	uint64_t numParallelPasses;
+	uint64_t numPrimes;
+	HistogramSnapshot passNanoseconds;
 };
 
 /**
 	This class is responsible for generating prime numbers efficiently at runtime.
 	The algorithm used is the Segmented Sieve of Eratosthenes. The space complexity
 	of a SieveOfEratosthenes object is O(N) where N = the number of calculated prime
-	numbers.
+	numbers that are not read from a mapped prime file.
+
+	The type parameter P is the word type used to store prime numbers. It is either 
+	uint32_t, which holds every prime below 2^32 in 4 bytes, or uint64_t for sieves 
+	that have to go further. The type parameter Store is the container that holds the
+	calculated primes, either a PrimeStore<P> or a CompactPrimeStore<P>.
 */
+template <typename P = uint32_t, typename Store = PrimeStore<P>>
 class SieveOfEratosthenes
 {
 public:
@@ -46,56 +51,150 @@ public:
 		then the sieve will start with no initial prime numbers and will start counting 
 		from 2.
 	*/
-	SieveOfEratosthenes(const std::vector<uint>* primeNumbers);
+	SieveOfEratosthenes(const std::vector<P>* primeNumbers = nullptr);
+
+	/**
+		This constructor uses the primes of a mapped prime file and continues sieving
+		after the highest number the file was tested up to. A PrimeStore reads the file
+		in place without copying it and stores primes calculated later in memory after 
+		the file.
+	*/
+	SieveOfEratosthenes(std::shared_ptr<const PrimeFile> primeFile);
+
+	/**
+		This method writes all currently calculated prime numbers to a prime file that
+		can be mapped by later processes.
+	*/
+	void save(const std::string& path) const;
 
 	/**
 		This method will return the prime number at a specified index starting at 0.
 		If the prime number at that index is not yet calculated, the sieve will begin 
 		calculating it. For large numbers this method can take a long time to calculate. 
 		If the number at the given index is already calculated, this runs in constant time.
+		Throws std::overflow_error if the prime at that index does not fit in P.
 	*/
-	uint getPrimeNumber(size_t index);
+	P getPrimeNumber(size_t index);
 
 	/**
-		Returns the vector containing all currently calculated prime numbers.
+		Returns the store containing all currently calculated prime numbers. Other 
+		threads may read the store while one thread calls getPrimeNumber, and they see
+		the primes of each sieved segment once the segment is complete.
 	*/
-	const std::vector<uint>& getCalculatedPrimes() const;
+	const Store& getCalculatedPrimes() const;
 
 	/**
 		Returns the number of prime numbers that have been calculated.
 	*/
 	size_t getNumCalculatedPrimes() const;
 
+	/**
+		Sets the number of threads used to sieve large ranges. Passing 1 disables
+		parallel sieving, and passing 0 uses one thread per hardware core.
+	*/
+	void setNumThreads(uint threads);
+
+	/**
+		Returns the number of threads used to sieve large ranges.
+	*/
+	uint getNumThreads() const;
+
+	/**
+		Returns the statistics of this sieve. This may be called from any thread.
+	*/
+	SieveStatistics getStatistics() const;
+
+	/**
+		Returns an upper bound on the nth prime number, counting from 1. This uses
+		Rosser's bound p(n) < n * (ln(n) + ln(ln(n))) for n >= 6, and Dusart's tighter
+		bound p(n) <= n * (ln(n) + ln(ln(n)) - 1 + (ln(ln(n)) - 2) / ln(n)) for 
+		n >= 688383.
+	*/
+	static ulong nthPrimeUpperBound(size_t n);
+
+	/**
+		Returns an upper bound on the number of primes less than or equal to x. This
+		uses Dusart's bound pi(x) < x / ln(x) * (1 + 1.2762 / ln(x)) for x > 1.
+	*/
+	static size_t primeCountUpperBound(ulong x);
+
 private:
 
 	/**
 		This function runs Segmented Sieve of Eratosthenes until there are at least
-		numPrimes calculated prime numbers.
+		numPrimes calculated prime numbers. The range that has to be sieved is known
+		ahead of time from an upper bound on the last prime, so the primes vector is
+		reserved once and large ranges are sieved in a single parallel pass.
 		
 		With N = the highest currently calculated prime number:
 		-------------------------------------------------------
 		Time complexity of calculation:
 		O(N * log(log(N)))
 
-		With K = the upper limit of the segment range:
+		With K = the upper limit of the segment range and C = the L1 data cache size:
 		-------------------------------------------------------
 		Space complexity of calculation:
-		O(sqrt(K))
+		O(sqrt(K) / log(K) + C)
 	*/
 	void sieve(size_t numPrimes);
 
+	/**
+		This function sieves every number from min up to at least max and appends the 
+		primes found to the primes vector. The range is split into chunks of whole 
+		segments which are sieved on numThreads threads and then merged in order. All of 
+		the primes up to sqrt(max) must already be calculated.
+	*/
+	void sieveParallel(ulong min, ulong max);
+
+	/**
+		This function sieves the next segment on the calling thread.
+	*/
+	void sieveNextSegment();
+
+	/**
+		This function adds every calculated prime whose square is below the end of the
+		next segment of a segment engine as a sieving prime. index is the position in
+		primes of the first prime that has not been added to the engine yet.
+	*/
+	void addSievingPrimes(WheelSegmentSieve& engine, size_t& index) const;
+
 	/**
 		This is the highest number that has been definitively tested for primality.
+		It can be larger than the largest value of P once every prime of type P has
+		been found.
 	*/
-	uint highestTestedNum;
+	ulong highestTestedNum;
 
 	/**
-		This is the number is used as the upper limit of the segment range.
+		This is the number of threads used to sieve large ranges.
 	*/
-	uint sieveLimit;
+	uint numThreads;
 
 	/**
-		This vector contains all of the calculated prime numbers in order.
+		This store contains all of the calculated prime numbers in order.
 	*/
-	std::vector<uint> primes;
+	Store primes;
+
+	/**
+		This vector receives the primes of one serial segment before they are appended
+		to the store. Its memory is reused by every segment.
+	*/
+	std::vector<P> segmentPrimes;
+
+	/**
+		This is the index into primes of the first prime that has not been added to
+		segmentSieve as a sieving prime.
+	*/
+	size_t numSievingPrimes;
+
+	/**
+		This is the segment engine that continues sieving after highestTestedNum. It
+		keeps the next multiple of every sieving prime between calls.
+	*/
+	WheelSegmentSieve segmentSieve;
+
+	StatisticsCounter numPasses;
+	StatisticsCounter numSegments;
+	StatisticsCounter numParallelPasses;
+	StatisticsHistogram passNanoseconds;
 };
\ No newline at end of file
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/**
+	These are the counters, histograms and timers that tables and sieves keep about
+	themselves. They are updated with relaxed atomic operations, so recording costs
+	about as much as an uncontended increment, and any thread can take a snapshot of
+	them while they are being updated.
+
+	Defining PRIMEBAG_NO_STATISTICS compiles all of them out. The classes keep their
+	interface but hold nothing, recording does nothing, no clock is read, and every
+	snapshot reads as 0.
+*/
+
+/**
+	A snapshot of a histogram. Bucket i counts the recorded values whose highest set
+	bit is bit i - 1, so bucket 0 counts zeros and every other bucket covers a range
+	from a power of two up to the next one.
+*/
+struct HistogramSnapshot
+{
+	static const size_t numBuckets = 65;
+
+	uint64_t buckets[numBuckets];
+	uint64_t count;
+	uint64_t sum;
+
+	/**
+		Returns an upper bound on the smallest value that at least the given fraction
+		of the recorded values are below or equal to, which is the end of the bucket
+		that value is in. Returns 0 if nothing was recorded.
+	*/
+	uint64_t quantile(double fraction) const
+	{
+		uint64_t target = uint64_t(fraction * double(count));
+		uint64_t seen = 0;
+
+		for (size_t bucket = 0; bucket < numBuckets; bucket++)
+		{
+			seen += buckets[bucket];
+
+			if (buckets[bucket] && seen >= target)
+			{
+				return bucket < 64 ? (uint64_t(1) << bucket) - 1 : UINT64_MAX;
+			}
+		}
+
+		return 0;
+	}
+};
+
+#ifndef PRIMEBAG_NO_STATISTICS
+
+/**
+	A StatisticsCounter is a number that only the owner of the statistics updates,
+	either as a running count or as a gauge that is set to the current value.
+*/
+class StatisticsCounter
+{
+public:
+	StatisticsCounter() : value(0)
+	{
+	}
+
+	void add(uint64_t amount = 1)
+	{
+		/*
+			Only the owner writes, so a plain load and store is enough and avoids a
+			locked read-modify-write.
+		*/
+		value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+	}
+
+	void set(uint64_t amount)
+	{
+		value.store(amount, std::memory_order_relaxed);
+	}
+
+	uint64_t load() const
+	{
+		return value.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<uint64_t> value;
+};
+
+/**
+	A StatisticsHistogram counts recorded values in power of two buckets, which is
+	enough to see the shape of a latency distribution and its tail.
+*/
+class StatisticsHistogram
+{
+public:
+	StatisticsHistogram() : count(0), sum(0)
+	{
+		for (size_t bucket = 0; bucket < HistogramSnapshot::numBuckets; bucket++)
+		{
+			buckets[bucket].store(0, std::memory_order_relaxed);
+		}
+	}
+
+	void record(uint64_t value)
+	{
+		buckets[getBucket(value)].fetch_add(1, std::memory_order_relaxed);
+		count.fetch_add(1, std::memory_order_relaxed);
+		sum.fetch_add(value, std::memory_order_relaxed);
+	}
+
+	/**
+		Returns the recorded values. A snapshot taken while values are recorded may
+		count a value in its bucket but not yet in the total, or the other way round.
+	*/
+	HistogramSnapshot snapshot() const
+	{
+		HistogramSnapshot result;
+
+		for (size_t bucket = 0; bucket < HistogramSnapshot::numBuckets; bucket++)
+		{
+			result.buckets[bucket] = buckets[bucket].load(std::memory_order_relaxed);
+		}
+
+		result.count = count.load(std::memory_order_relaxed);
+		result.sum = sum.load(std::memory_order_relaxed);
+
+		return result;
+	}
+
+private:
+	/**
+		Returns the number of bits needed to hold a value.
+	*/
+	static size_t getBucket(uint64_t value)
+	{
+		if (!value)
+		{
+			return 0;
+		}
+
+#if defined(_MSC_VER) && defined(_M_IX86)
+		/*
+			_BitScanReverse64 only exists on 64-bit targets, so the high and low
+			halves are scanned separately.
+		*/
+		unsigned long index;
+
+		if (_BitScanReverse(&index, static_cast<unsigned long>(value >> 32)))
+		{
+			return size_t(index) + 33;
+		}
+
+		_BitScanReverse(&index, static_cast<unsigned long>(value));
+
+		return size_t(index) + 1;
+#elif defined(_MSC_VER)
+		unsigned long index;
+		_BitScanReverse64(&index, value);
+
+		return size_t(index) + 1;
+#else
+		return size_t(64 - __builtin_clzll(value));
+#endif
+	}
+
+	std::atomic<uint64_t> buckets[HistogramSnapshot::numBuckets];
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> sum;
+};
+
+/**
+	A StatisticsTimer measures the nanoseconds since it was created.
+*/
+class StatisticsTimer
+{
+public:
+	StatisticsTimer() : begin(std::chrono::steady_clock::now())
+	{
+	}
+
+	uint64_t getNanoseconds() const
+	{
+		return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+	}
+
+private:
+	std::chrono::steady_clock::time_point begin;
+};
+
+#else
+
+class StatisticsCounter
+{
+public:
+	void add(uint64_t = 1)
+	{
+	}
+
+	void set(uint64_t)
+	{
+	}
+
+	uint64_t load() const
+	{
+		return 0;
+	}
+};
+
+class StatisticsHistogram
+{
+public:
+	void record(uint64_t)
+	{
+	}
+
+	HistogramSnapshot snapshot() const
+	{
+		return HistogramSnapshot();
+	}
+};
+
+class StatisticsTimer
+{
+public:
+	uint64_t getNanoseconds() const
+	{
+		return 0;
+	}
+};
+
+#endif
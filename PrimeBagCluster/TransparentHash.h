@@ -0,0 +1,38 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+/**
+	A TransparentHash hashes values of type V and anything that can be looked up in
+	place of one, so that tables keyed by V can be searched without constructing a
+	V. Any key that compares equal to a value must hash like it.
+
+	By default a key is converted to V and hashed by std::hash<V>, which is always
+	correct but builds the temporary the lookup was meant to avoid. Value types with
+	cheap views have specializations.
+*/
+template <typename V>
+struct TransparentHash
+{
+	size_t operator()(const V& value) const
+	{
+		return std::hash<V>()(value);
+	}
+};
+
+/**
+	Strings are hashed through a string view, so std::string, std::string_view and
+	null-terminated character arrays with the same characters all hash alike and
+	none of them is copied.
+*/
+template <typename C, typename T, typename A>
+struct TransparentHash<std::basic_string<C, T, A>>
+{
+	size_t operator()(std::basic_string_view<C, T> view) const
+	{
+		return std::hash<std::basic_string_view<C, T>>()(view);
+	}
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+/**
+	A ValueCodec turns values of type V into the bytes they are stored as in a
+	PrimeTableFile and back. Values that compare equal must have equal bytes, since
+	a mapped table finds a value by hashing and comparing its bytes.
+
+	By default a value is stored as its object representation, which suits integers
+	and enums. Types with padding or several representations of one value, such as
+	floating point numbers, need a specialization.
+*/
+template <typename V>
+struct ValueCodec
+{
+	static_assert(std::is_trivially_copyable<V>::value, "Values without a ValueCodec specialization must be trivially copyable.");
+
+	/**
+		Returns the bytes of a value. They refer to the value, so they must be used
+		before it goes away. A key of another type is converted to V, and the bytes
+		of that temporary only last until the end of the full expression.
+	*/
+	static std::string_view encode(const V& value)
+	{
+		return std::string_view(reinterpret_cast<const char*>(&value), sizeof(V));
+	}
+
+	/**
+		Returns the value stored as the given bytes. Throws std::runtime_error if 
+		there are not exactly as many bytes as a value has, which only a corrupt file
+		can hold.
+	*/
+	static V decode(std::string_view bytes)
+	{
+		if (bytes.size() != sizeof(V))
+		{
+			throw std::runtime_error("A stored value has the wrong size.");
+		}
+
+		V value;
+		std::memcpy(&value, bytes.data(), sizeof(V));
+
+		return value;
+	}
+};
+
+/**
+	Strings are stored as their characters, and keys are taken as string views like
+	in TransparentHash, so looking up a string view or a character array copies
+	nothing.
+*/
+template <typename C, typename T, typename A>
+struct ValueCodec<std::basic_string<C, T, A>>
+{
+	static std::string_view encode(std::basic_string_view<C, T> value)
+	{
+		return std::string_view(reinterpret_cast<const char*>(value.data()), value.size() * sizeof(C));
+	}
+
+	/**
+		The bytes are copied rather than cast, since stored values are not aligned.
+		Throws std::runtime_error if the bytes do not hold a whole number of 
+		characters.
+	*/
+	static std::basic_string<C, T, A> decode(std::string_view bytes)
+	{
+		if (bytes.size() % sizeof(C))
+		{
+			throw std::runtime_error("A stored string has the wrong size.");
+		}
+
+		std::basic_string<C, T, A> value(bytes.size() / sizeof(C), C());
+		std::memcpy(&value[0], bytes.data(), value.size() * sizeof(C));
+
+		return value;
+	}
+};
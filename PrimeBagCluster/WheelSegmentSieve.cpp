@@ -0,0 +1,567 @@
+#include "WheelSegmentSieve.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PRESIEVE_SSE2
+#include <emmintrin.h>
+#endif
+
+typedef unsigned int uint;
+typedef unsigned long long ulong;
+
+/**
+	The primes whose multiples are crossed off by the pre-sieve patterns. Each group
+	forms one pattern, which repeats every 7 * 11 * 13 = 1001 and 17 * 19 * 23 = 7429
+	bytes respectively. Both patterns are small enough to stay in the L1 cache next
+	to the segment.
+*/
+static const uint presievedPrimes[2][3] = { { 7, 11, 13 }, { 17, 19, 23 } };
+
+static const uint largestPresievedPrime = 23;
+
+/**
+	The number of bytes combined at once when a segment is filled. Each pattern is 
+	stored with this many extra bytes past its period, so a full vector can be loaded
+	from any position within the period.
+*/
+static const size_t presieveVectorBytes = 32;
+
+/**
+	A segment of wheel bytes with the multiples of a group of primes crossed off. It
+	starts at 0 and repeats every period bytes.
+*/
+struct PresievePattern
+{
+	size_t period;
+	std::vector<uint8_t> bytes;
+};
+
+static PresievePattern makePresievePattern(const uint (&primes)[3])
+{
+	PresievePattern pattern;
+	pattern.period = primes[0] * primes[1] * primes[2];
+	pattern.bytes.assign(pattern.period + presieveVectorBytes, uint8_t(0xFF));
+
+	for (size_t index = 0; index < pattern.bytes.size(); index++)
+	{
+		for (uint bit = 0; bit < 8; bit++)
+		{
+			ulong number = 30 * ulong(index % pattern.period) + wheelResidues[bit];
+
+			for (uint prime : primes)
+			{
+				if (number % prime == 0)
+				{
+					pattern.bytes[index] &= uint8_t(~(1u << bit));
+				}
+			}
+		}
+	}
+
+	return pattern;
+}
+
+/**
+	Returns the two pre-sieve patterns. They are built on first use.
+*/
+static const PresievePattern* getPresievePatterns()
+{
+	static const PresievePattern patterns[2] = { makePresievePattern(presievedPrimes[0]), makePresievePattern(presievedPrimes[1]) };
+
+	return patterns;
+}
+
+/**
+	The smallest segment, so that a prime found inside a segment is always smaller
+	than the segment and never sieves from a bucket.
+*/
+static const size_t minSegmentBytes = 64;
+
+/**
+	The largest segment, so that an offset within a segment fits in the upper 26 bits
+	of BucketPrime::offsetAndWheel.
+*/
+static const size_t maxSegmentBytes = size_t(1) << 26;
+
+/**
+	A step of a bucket prime p from its multiple p * q to p * q', where q' is the next
+	number after q that is coprime to 30. The byte offset of the multiple moves by 
+	p / 30 * gap + correction, and mask clears the bit of p * q.
+*/
+struct WheelStep
+{
+	uint8_t mask;
+	uint8_t gap;
+	uint8_t correction;
+};
+
+/**
+	The steps for every residue of p and of q, both as indices into wheelResidues.
+*/
+struct WheelSteps
+{
+	WheelStep steps[8][8];
+};
+
+static WheelSteps makeWheelSteps()
+{
+	WheelSteps wheelSteps;
+
+	for (uint primeIndex = 0; primeIndex < 8; primeIndex++)
+	{
+		for (uint wheelIndex = 0; wheelIndex < 8; wheelIndex++)
+		{
+			uint primeResidue = wheelResidues[primeIndex], residue = wheelResidues[wheelIndex];
+			uint gap = (wheelIndex < 7 ? wheelResidues[wheelIndex + 1] : 31) - residue;
+
+			WheelStep& step = wheelSteps.steps[primeIndex][wheelIndex];
+			step.mask = uint8_t(~(1u << wheelBitIndex[primeResidue * residue % 30]));
+			step.gap = uint8_t(gap);
+			step.correction = uint8_t(primeResidue * (residue + gap) / 30 - primeResidue * residue / 30);
+		}
+	}
+
+	return wheelSteps;
+}
+
+/**
+	Returns the wheel steps of bucket primes. They are built on first use.
+*/
+static const WheelSteps& getWheelSteps()
+{
+	static const WheelSteps wheelSteps = makeWheelSteps();
+
+	return wheelSteps;
+}
+
+WheelSegmentSieve::WheelSegmentSieve(ulong min, size_t segmentBytes)
+	: base(min - min % 30), min(min), largestSievingPrime(largestPresievedPrime)
+{
+	segment.resize(std::min(std::max(segmentBytes ? segmentBytes : detectCacheSize(), minSegmentBytes), maxSegmentBytes));
+}
+
+template <typename P>
+void WheelSegmentSieve::sieveNextSegment(std::vector<P>& out, ulong max)
+{
+	ulong high = base + 30 * ulong(segment.size());
+
+	/*
+		Initially, all numbers coprime to 30 and to the pre-sieved primes will be 
+		considered prime. The remaining composite numbers will be sieved out.
+	*/
+	presieve(segment.data(), segment.size(), base);
+
+	/*
+		The first segment starts with 1, which is coprime to 30 but not a prime.
+	*/
+	if (base == 0)
+	{
+		segment[0] &= uint8_t(~1u);
+	}
+
+	/*
+		2, 3 and 5 are not represented by the wheel.
+	*/
+	for (uint prime : { 2u, 3u, 5u })
+	{
+		if (prime >= min && prime <= max && prime < high)
+		{
+			out.push_back(P(prime));
+		}
+	}
+
+	/*
+		Sieve out the multiples of each sieving prime. Their offsets already point
+		into this segment.
+	*/
+	for (SievingPrime& sievingPrime : sievingPrimes)
+	{
+		crossOff(sievingPrime);
+	}
+
+	crossOffBucket();
+
+	for (size_t index = 0; index < segment.size(); index++)
+	{
+		uint8_t bits = segment[index];
+
+		for (uint bit = 0; bits; bit++, bits >>= 1)
+		{
+			if (!(bits & 1))
+			{
+				continue;
+			}
+
+			ulong number = base + 30 * ulong(index) + wheelResidues[bit];
+
+			/*
+				Numbers below min were tested before this sieve started, and numbers
+				above max are not wanted.
+			*/
+			if (number < min || number > max)
+			{
+				continue;
+			}
+
+			/*
+				A prime whose square is still in this segment has to sieve the rest
+				of it before the scan gets there.
+			*/
+			if (number > largestSievingPrime && number <= 0xFFFFFFFFu && number * number < high)
+			{
+				discoverSievingPrime(uint(number));
+			}
+
+			out.push_back(P(number));
+		}
+	}
+
+	base = high;
+	min = high;
+}
+
+template void WheelSegmentSieve::sieveNextSegment<uint32_t>(std::vector<uint32_t>& out, ulong max);
+template void WheelSegmentSieve::sieveNextSegment<uint64_t>(std::vector<uint64_t>& out, ulong max);
+
+void WheelSegmentSieve::seek(ulong min)
+{
+	this->base = min - min % 30;
+	this->min = min;
+
+	for (SievingPrime& sievingPrime : sievingPrimes)
+	{
+		findNextMultiples(sievingPrime);
+	}
+
+	/*
+		The bucket primes are sorted into new buckets from the new position.
+	*/
+	std::vector<uint> bucketPrimes;
+
+	for (const std::vector<BucketPrime>& bucket : buckets)
+	{
+		for (const BucketPrime& bucketPrime : bucket)
+		{
+			bucketPrimes.push_back(bucketPrime.prime);
+		}
+	}
+
+	buckets.clear();
+
+	for (uint prime : bucketPrimes)
+	{
+		addBucketPrime(prime);
+	}
+}
+
+ulong WheelSegmentSieve::getNextNumber() const
+{
+	return min;
+}
+
+ulong WheelSegmentSieve::getSegmentEnd() const
+{
+	return base + getSegmentNumbers();
+}
+
+ulong WheelSegmentSieve::getSegmentNumbers() const
+{
+	return 30 * ulong(segment.size());
+}
+
+size_t WheelSegmentSieve::detectCacheSize()
+{
+	size_t size = 0;
+
+#ifdef _WIN32
+	DWORD length = 0;
+	GetLogicalProcessorInformation(nullptr, &length);
+
+	std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+
+	if (!info.empty() && GetLogicalProcessorInformation(info.data(), &length))
+	{
+		for (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION& entry : info)
+		{
+			if (entry.Relationship == RelationCache && entry.Cache.Level == 1 && entry.Cache.Type != CacheInstruction)
+			{
+				size = entry.Cache.Size;
+				break;
+			}
+		}
+	}
+#elif defined(_SC_LEVEL1_DCACHE_SIZE)
+	long result = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+
+	if (result > 0)
+	{
+		size = size_t(result);
+	}
+#endif
+
+	/*
+		Fall back to the most common L1 data cache size.
+	*/
+	return size ? size : 32768;
+}
+
+void WheelSegmentSieve::presieve(uint8_t* data, size_t size, ulong base)
+{
+	const PresievePattern* patterns = getPresievePatterns();
+	const uint8_t* first = patterns[0].bytes.data();
+	const uint8_t* second = patterns[1].bytes.data();
+	size_t firstPeriod = patterns[0].period, secondPeriod = patterns[1].period;
+
+	/*
+		Find where this segment starts in each pattern.
+	*/
+	size_t firstOffset = size_t(base / 30 % firstPeriod);
+	size_t secondOffset = size_t(base / 30 % secondPeriod);
+
+	size_t index = 0;
+
+	/*
+		Combine the two patterns a vector at a time, wrapping each one around when it
+		passes its period.
+	*/
+#if defined(__AVX2__)
+	const size_t vectorBytes = 32;
+
+	for (; index + vectorBytes <= size; index += vectorBytes)
+	{
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + firstOffset));
+		__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(second + secondOffset));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(data + index), _mm256_and_si256(a, b));
+#elif defined(PRESIEVE_SSE2)
+	const size_t vectorBytes = 16;
+
+	for (; index + vectorBytes <= size; index += vectorBytes)
+	{
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + firstOffset));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(second + secondOffset));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(data + index), _mm_and_si128(a, b));
+#else
+	const size_t vectorBytes = 8;
+
+	for (; index + vectorBytes <= size; index += vectorBytes)
+	{
+		uint64_t a, b;
+		memcpy(&a, first + firstOffset, vectorBytes);
+		memcpy(&b, second + secondOffset, vectorBytes);
+		a &= b;
+		memcpy(data + index, &a, vectorBytes);
+#endif
+
+		firstOffset += vectorBytes;
+		secondOffset += vectorBytes;
+
+		if (firstOffset >= firstPeriod)
+		{
+			firstOffset -= firstPeriod;
+		}
+
+		if (secondOffset >= secondPeriod)
+		{
+			secondOffset -= secondPeriod;
+		}
+	}
+
+	for (; index < size; index++)
+	{
+		data[index] = first[firstOffset++] & second[secondOffset++];
+	}
+
+	/*
+		The patterns cross off the pre-sieved primes themselves, which all lie in the
+		first byte.
+	*/
+	if (base == 0)
+	{
+		for (const uint (&group)[3] : presievedPrimes)
+		{
+			for (uint prime : group)
+			{
+				data[0] |= uint8_t(1u << wheelBitIndex[prime]);
+			}
+		}
+	}
+}
+
+void WheelSegmentSieve::findNextMultiples(SievingPrime& sievingPrime) const
+{
+	uint prime = sievingPrime.prime;
+
+	/*
+		We only need to loop from prime ^ 2 onwards.
+		All other multiples will be found from other primes.
+	*/
+	ulong start = std::max(ulong(prime) * prime, base);
+
+	for (uint residue = 0; residue < 8; residue++)
+	{
+		/*
+			Find the smallest q >= start / prime in this residue class.
+		*/
+		ulong q = (start + prime - 1) / prime;
+		q += (wheelResidues[residue] + 30 - q % 30) % 30;
+
+		sievingPrime.next[residue] = uint((q * prime - base) / 30);
+	}
+}
+
+void WheelSegmentSieve::crossOff(SievingPrime& sievingPrime)
+{
+	uint prime = sievingPrime.prime;
+	uint8_t* data = segment.data();
+	size_t size = segment.size();
+
+	for (uint residue = 0; residue < 8; residue++)
+	{
+		uint8_t mask = uint8_t(~(1u << wheelBitIndex[prime % 30 * wheelResidues[residue] % 30]));
+		size_t index = sievingPrime.next[residue];
+
+		for (; index < size; index += prime)
+		{
+			/*
+				Mark the multiples as composite.
+			*/
+			data[index] &= mask;
+		}
+
+		sievingPrime.next[residue] = uint(index - size);
+	}
+}
+
+void WheelSegmentSieve::addSievingPrime(uint prime)
+{
+	if (prime <= largestSievingPrime)
+	{
+		return;
+	}
+
+	largestSievingPrime = prime;
+
+	/*
+		Each residue class of a prime at least as large as the segment in bytes hits
+		a segment at most once, so it is cheaper to sieve it from a bucket.
+	*/
+	if (prime >= segment.size())
+	{
+		addBucketPrime(prime);
+		return;
+	}
+
+	SievingPrime sievingPrime;
+	sievingPrime.prime = prime;
+
+	findNextMultiples(sievingPrime);
+
+	sievingPrimes.push_back(sievingPrime);
+}
+
+void WheelSegmentSieve::addBucketPrime(uint prime)
+{
+	ulong start = std::max(ulong(prime) * prime, base);
+
+	/*
+		Find the smallest q >= start / prime that is coprime to 30.
+	*/
+	ulong q = (start + prime - 1) / prime;
+	ulong block = q - q % 30;
+	uint wheelIndex = 0;
+
+	while (wheelIndex < 8 && block + wheelResidues[wheelIndex] < q)
+	{
+		wheelIndex++;
+	}
+
+	if (wheelIndex == 8)
+	{
+		block += 30;
+		wheelIndex = 0;
+	}
+
+	ulong multiple = (block + wheelResidues[wheelIndex]) * prime;
+
+	fileBucketPrime(prime, wheelBitIndex[prime % 30], (multiple - base) / 30, wheelIndex);
+}
+
+void WheelSegmentSieve::fileBucketPrime(uint prime, uint primeIndex, ulong offset, uint wheelIndex)
+{
+	size_t index = size_t(offset / segment.size());
+
+	while (buckets.size() <= index)
+	{
+		buckets.emplace_back();
+	}
+
+	buckets[index].push_back(BucketPrime{ prime, uint(offset % segment.size()) << 6 | primeIndex << 3 | wheelIndex });
+}
+
+void WheelSegmentSieve::crossOffBucket()
+{
+	if (buckets.empty())
+	{
+		return;
+	}
+
+	const WheelSteps& wheelSteps = getWheelSteps();
+	uint8_t* data = segment.data();
+	ulong size = segment.size();
+
+	/*
+		Every prime leaves the bucket for a later one, and adding buckets to the back 
+		of the deque keeps this reference valid.
+	*/
+	std::vector<BucketPrime>& bucket = buckets.front();
+
+	for (const BucketPrime& bucketPrime : bucket)
+	{
+		uint prime = bucketPrime.prime;
+		uint primeIndex = bucketPrime.offsetAndWheel >> 3 & 7;
+		uint wheelIndex = bucketPrime.offsetAndWheel & 7;
+		ulong offset = bucketPrime.offsetAndWheel >> 6;
+		ulong stride = prime / 30;
+		const WheelStep* steps = wheelSteps.steps[primeIndex];
+
+		for (; offset < size; wheelIndex = (wheelIndex + 1) & 7)
+		{
+			/*
+				Mark the multiple as composite and move on to the next one.
+			*/
+			data[offset] &= steps[wheelIndex].mask;
+			offset += stride * steps[wheelIndex].gap + steps[wheelIndex].correction;
+		}
+
+		fileBucketPrime(prime, primeIndex, offset, wheelIndex);
+	}
+
+	/*
+		The empty bucket is reused as the last one, so the next segment's bucket moves
+		to the front.
+	*/
+	bucket.clear();
+	buckets.push_back(std::move(bucket));
+	buckets.pop_front();
+}
+
+void WheelSegmentSieve::discoverSievingPrime(uint prime)
+{
+	/*
+		A prime found inside a segment is below the square root of the segment end, 
+		which is too small for a bucket.
+	*/
+	addSievingPrime(prime);
+	crossOff(sievingPrimes.back());
+}
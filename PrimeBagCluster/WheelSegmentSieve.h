@@ -0,0 +1,201 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <cstddef>
+#include <cstdint>
+
+typedef unsigned long long ulong;
+typedef unsigned int uint;
+
+/**
+	The residues modulo 30 that are coprime to 30. Every prime number greater than 5
+	falls on one of these residues, so a segment stores one bit per residue and each
+	byte of a segment covers 30 consecutive integers.
+*/
+static const uint wheelResidues[8] = { 1, 7, 11, 13, 17, 19, 23, 29 };
+
+/**
+	Maps a residue modulo 30 to its bit position within a segment byte. Residues that
+	share a factor with 30 are never stored and map to 0xFF.
+*/
+static const uint8_t wheelBitIndex[30] = {
+	0xFF, 0, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 1, 0xFF, 0xFF,
+	0xFF, 2, 0xFF, 3, 0xFF, 0xFF, 0xFF, 4, 0xFF, 5,
+	0xFF, 0xFF, 0xFF, 6, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 7
+};
+
+/**
+	This class sieves consecutive, equally sized wheel segments. Each byte of a segment
+	represents 30 consecutive integers, one bit for each residue in wheelResidues, and
+	the segment size is chosen to fit in the L1 data cache.
+
+	The multiples of 7 to 23 are not sieved. Every segment starts as a copy of a
+	precomputed periodic pattern that already has them crossed off, and only the primes
+	from 29 upwards whose square falls below the end of a segment are used to sieve it.
+	Each of those sieving primes remembers where its next multiple lies, so moving on to
+	the following segment never has to recompute a starting point from prime * prime.
+
+	Primes that are large compared to a segment hit it about once or not at all. These
+	are kept in buckets instead, one for each upcoming segment, and each of them sits in
+	the bucket of the segment that holds its next multiple. A segment only visits the
+	primes in its own bucket, so its work grows with the number of hits rather than
+	with the number of sieving primes.
+*/
+class WheelSegmentSieve
+{
+public:
+	/**
+		This constructor places the first segment at the multiple of 30 at or below min.
+		Numbers below min are never reported. If segmentBytes is 0, the segment size is
+		taken from the detected L1 data cache size. Segments are between
+		64 bytes and 64 MiB.
+	*/
+	WheelSegmentSieve(ulong min, size_t segmentBytes = 0);
+
+	/**
+		This method sieves the next segment and appends the primes in it up to max to 
+		out in order. Every prime below the start of the segment whose square is below 
+		getSegmentEnd() must have been added with addSievingPrime. Primes inside the 
+		segment are discovered and sieved as they are found. The segment end must stay
+		below 2^64.
+	*/
+	template <typename P>
+	void sieveNextSegment(std::vector<P>& out, ulong max);
+
+	/**
+		This method registers a prime that sieves the following segments. Primes must 
+		be added in increasing order; the primes up to 23 and primes that are not larger
+		than the largest sieving prime are ignored. Large primes take a bucket for every
+		segment up to their next multiple, so they should be added shortly before their
+		square is reached.
+	*/
+	void addSievingPrime(uint prime);
+
+	/**
+		This method moves the sieve so that the next segment starts at min. The sieving
+		primes are kept and their next multiples are recalculated.
+	*/
+	void seek(ulong min);
+
+	/**
+		Returns the lowest number that has not been sieved yet.
+	*/
+	ulong getNextNumber() const;
+
+	/**
+		Returns the number after the last number of the next segment.
+	*/
+	ulong getSegmentEnd() const;
+
+	/**
+		Returns the number of integers covered by one segment.
+	*/
+	ulong getSegmentNumbers() const;
+
+	/**
+		Returns the size of the L1 data cache in bytes, or 32 KiB if it cannot be
+		detected.
+	*/
+	static size_t detectCacheSize();
+
+	/**
+		Fills the wheel segment of size bytes at data that starts at base, a multiple
+		of 30, with the pre-sieved pattern for its position. Only the multiples of 7 to
+		23 are crossed off in it.
+	*/
+	static void presieve(uint8_t* data, size_t size, ulong base);
+
+private:
+	/**
+		A prime used to sieve segments. The multiples prime * q with q coprime to 30
+		split into 8 classes, one for each residue of q. The multiples in a class all
+		land on the same bit and are exactly prime bytes apart, so each class is stored
+		as the byte offset of its next multiple relative to the current segment.
+	*/
+	struct SievingPrime
+	{
+		uint prime;
+		uint next[8];
+	};
+
+	/**
+		A prime that sieves from a bucket. Its next multiple is prime * q for some q 
+		coprime to 30. The bits of offsetAndWheel hold, from the lowest, the index of 
+		q % 30 in wheelResidues, the index of prime % 30 in wheelResidues, and the byte 
+		offset of the multiple within the segment of the bucket.
+	*/
+	struct BucketPrime
+	{
+		uint prime;
+		uint offsetAndWheel;
+	};
+
+	/**
+		Calculates the next multiples of a sieving prime at or above max(prime ^ 2, base).
+	*/
+	void findNextMultiples(SievingPrime& sievingPrime) const;
+
+	/**
+		Marks off the multiples of a sieving prime in the current segment and moves its
+		offsets on to the following segment.
+	*/
+	void crossOff(SievingPrime& sievingPrime);
+
+	/**
+		Finds the next multiple of a bucket prime at or above max(prime ^ 2, base) and 
+		puts the prime in its bucket.
+	*/
+	void addBucketPrime(uint prime);
+
+	/**
+		Puts a bucket prime into the bucket of the segment that contains offset, which 
+		is the byte offset of its next multiple from the current segment.
+	*/
+	void fileBucketPrime(uint prime, uint primeIndex, ulong offset, uint wheelIndex);
+
+	/**
+		Marks off the multiples of the primes in the bucket of the current segment and
+		moves each prime on to the bucket of its next multiple.
+	*/
+	void crossOffBucket();
+
+	/**
+		Registers a prime found inside the current segment and marks off its multiples 
+		in the rest of the segment.
+	*/
+	void discoverSievingPrime(uint prime);
+
+	/**
+		This is the number represented by the first byte of the current segment. It is
+		always a multiple of 30.
+	*/
+	ulong base;
+
+	/**
+		This is the lowest number of the current segment that should be reported.
+	*/
+	ulong min;
+
+	/**
+		This is the wheel segment being sieved. Its memory is reused by every segment.
+	*/
+	std::vector<uint8_t> segment;
+
+	/**
+		These are the primes used to sieve segments, in increasing order.
+	*/
+	std::vector<SievingPrime> sievingPrimes;
+
+	/**
+		These are the buckets of the current and the following segments. The bucket of
+		the current segment is at the front.
+	*/
+	std::deque<std::vector<BucketPrime>> buckets;
+
+	/**
+		This is the largest prime that has been added, whether it sieves directly or
+		from a bucket.
+	*/
+	uint largestSievingPrime;
+};
@@ -0,0 +1,285 @@
+#pragma once
+
+#include <cstddef>
+#include <boost/multiprecision/cpp_int.hpp>
+
+/**
+	A WordDivisor tests whether numbers are divisible by a word prime, and divides
+	them once they are known to be, without a hardware division. It holds the
+	inverse of the prime modulo 2^64 and multiplies the limbs of a number by it from
+	the lowest one up, which is the exact division of Granlund and Montgomery. That
+	costs two multiplications per limb, where the remainder of a cpp_int costs a
+	division per limb.
+
+	Only odd primes have an inverse, so the one even prime is tested and divided
+	with shifts. A prime wider than a limb of cpp_int, which happens with 64-bit
+	primes where the limbs are 32 bits, falls back to the operators of cpp_int.
+
+	Inverses take a few multiplications to calculate, so a PrimeTable keeps the
+	inverse of each prime it hands out and bags get their divisors from it.
+*/
+class WordDivisor
+{
+	typedef boost::multiprecision::cpp_int bignum;
+	typedef boost::multiprecision::limb_type limb;
+	typedef boost::multiprecision::double_limb_type doubleLimb;
+	typedef unsigned long long ulong;
+	typedef unsigned int uint;
+
+public:
+	/**
+		This constructor makes an empty divisor, which stands for a value that has
+		no prime.
+	*/
+	WordDivisor() : prime(0), inverse(0)
+	{
+	}
+
+	explicit WordDivisor(ulong prime) : prime(prime), inverse(invert(prime))
+	{
+	}
+
+	/**
+		This constructor takes an inverse that was calculated by invert before.
+	*/
+	WordDivisor(ulong prime, ulong inverse) : prime(prime), inverse(inverse)
+	{
+	}
+
+	/**
+		Returns the inverse of an odd number modulo 2^64, or 0 if the number is even.
+	*/
+	static ulong invert(ulong number)
+	{
+		if (!(number & 1))
+		{
+			return 0;
+		}
+
+		/*
+			An odd number is its own inverse modulo 8, and each Newton step doubles the
+			number of correct low bits, from 3 to 96.
+		*/
+		ulong result = number;
+
+		for (uint step = 0; step < 5; step++)
+		{
+			result *= 2 - number * result;
+		}
+
+		return result;
+	}
+
+	/**
+		Returns the prime, or 0 if the divisor is empty.
+	*/
+	ulong getPrime() const
+	{
+		return prime;
+	}
+
+	bool divides(const bignum& number) const
+	{
+		if (!fitsLimb())
+		{
+			return !boost::multiprecision::integer_modulus(number, prime);
+		}
+
+		if (!inverse)
+		{
+			return !(*number.backend().limbs() & 1);
+		}
+
+		return isMultiple(reduce(number.backend().limbs(), number.backend().size(), nullptr));
+	}
+
+	/**
+		Tests a native unsigned integer, which is split into limbs for the same
+		kernel. A 64-bit or 128-bit remainder is a slow division on most machines.
+	*/
+	template <typename Word>
+	bool divides(Word number) const
+	{
+		if (!fitsLimb())
+		{
+			return !(number % prime);
+		}
+
+		if (!inverse)
+		{
+			return !(number & 1);
+		}
+
+		limb limbs[numLimbs<Word>()];
+
+		return isMultiple(reduce(limbs, split(number, limbs), nullptr));
+	}
+
+	/**
+		Divides a number by the prime in place. The result is only meaningful if the
+		prime divides the number.
+	*/
+	void divideExact(bignum& number) const
+	{
+		if (!fitsLimb())
+		{
+			number /= prime;
+			return;
+		}
+
+		if (!inverse)
+		{
+			number >>= 1;
+			return;
+		}
+
+		/*
+			Each limb of the quotient is written after the limb of the number in its
+			place has been read, so the division can run in place.
+		*/
+		limb* limbs = number.backend().limbs();
+
+		reduce(limbs, number.backend().size(), limbs);
+		number.backend().normalize();
+	}
+
+	template <typename Word>
+	void divideExact(Word& number) const
+	{
+		if (!fitsLimb())
+		{
+			number /= prime;
+			return;
+		}
+
+		if (!inverse)
+		{
+			number >>= 1;
+			return;
+		}
+
+		limb limbs[numLimbs<Word>()];
+		size_t size = split(number, limbs);
+
+		reduce(limbs, size, limbs);
+		number = join<Word>(limbs, size);
+	}
+
+	/**
+		Divides the prime out of a number as often as it divides it, and returns how
+		often that was.
+	*/
+	template <typename Number>
+	uint divideOut(Number& number) const
+	{
+		uint result = 0;
+
+		while (divides(number))
+		{
+			divideExact(number);
+			result++;
+		}
+
+		return result;
+	}
+
+private:
+	static const uint limbBits = uint(8 * sizeof(limb));
+
+	bool fitsLimb() const
+	{
+		return prime <= ulong(limb(~limb(0)));
+	}
+
+	/**
+		Runs the exact division over limbs from the lowest one up, writing the limbs
+		of the quotient to quotient if it is not null, and returns the final carry.
+		The limbs are divisible by the prime if and only if the carry is 0 or the
+		prime, and the quotient is only meaningful if they are.
+	*/
+	limb reduce(const limb* limbs, size_t size, limb* quotient) const
+	{
+		limb divisor = limb(prime);
+		limb factor = limb(inverse);
+		limb carry = 0;
+
+		for (size_t index = 0; index < size; index++)
+		{
+			limb number = limbs[index];
+			limb borrow = number < carry;
+			limb digit = limb(number - carry) * factor;
+
+			if (quotient)
+			{
+				quotient[index] = digit;
+			}
+
+			carry = limb((doubleLimb(digit) * divisor) >> limbBits) + borrow;
+		}
+
+		return carry;
+	}
+
+	bool isMultiple(limb carry) const
+	{
+		return !carry || carry == limb(prime);
+	}
+
+	template <typename Word>
+	static constexpr size_t numLimbs()
+	{
+		return sizeof(Word) > sizeof(limb) ? sizeof(Word) / sizeof(limb) : 1;
+	}
+
+	/**
+		Writes the limbs of a number from the lowest one up and returns how many there
+		are, leaving out high limbs that are 0.
+	*/
+	template <typename Word>
+	static size_t split(Word number, limb* limbs)
+	{
+		size_t size = 0;
+
+		do
+		{
+			limbs[size++] = limb(number);
+
+			if constexpr (sizeof(Word) > sizeof(limb))
+			{
+				number >>= limbBits;
+			}
+			else
+			{
+				number = 0;
+			}
+		} while (number);
+
+		return size;
+	}
+
+	template <typename Word>
+	static Word join(const limb* limbs, size_t size)
+	{
+		Word number = 0;
+
+		for (size_t index = size; index-- > 0;)
+		{
+			if constexpr (sizeof(Word) > sizeof(limb))
+			{
+				number <<= limbBits;
+			}
+
+			number |= Word(limbs[index]);
+		}
+
+		return number;
+	}
+
+	ulong prime;
+
+	/**
+		The inverse of the prime modulo 2^64, or 0 if the prime is 2. With 32-bit
+		limbs its low half is the inverse modulo 2^32.
+	*/
+	ulong inverse;
+};
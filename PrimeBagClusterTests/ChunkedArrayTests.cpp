@@ -0,0 +1,116 @@
+#include "Test.h"
+#include "ChunkedArray.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+/**
+	Appends elements one by one and in ranges, across enough chunks that the chunk
+	directory has to grow.
+*/
+static void testAppend()
+{
+	ChunkedArray<uint32_t> array;
+	size_t numElements = 20 * ChunkedArray<uint32_t>::chunkSize + 5;
+
+	CHECK(array.size() == 0);
+
+	std::vector<uint32_t> range;
+
+	for (uint32_t element = 0; element < numElements; element++)
+	{
+		if (element % 3)
+		{
+			range.push_back(element);
+		}
+		else
+		{
+			array.append(range.begin(), range.end());
+			range.clear();
+			array.push_back(element);
+		}
+	}
+
+	array.append(range.begin(), range.end());
+
+	CHECK(array.size() == numElements);
+	CHECK(array.capacity() >= numElements);
+
+	bool inOrder = true;
+
+	for (size_t index = 0; index < numElements; index++)
+	{
+		inOrder &= array[index] == index;
+	}
+
+	CHECK(inOrder);
+
+	/*
+		Elements keep their address while the array grows.
+	*/
+	const uint32_t* first = &array[0];
+
+	array.reserve(2 * numElements);
+
+	CHECK(first == &array[0]);
+}
+
+/**
+	Reads the array from several threads while one thread appends to it. Every
+	element below a size a reader has seen must be fully written.
+*/
+static void testConcurrentReaders()
+{
+	ChunkedArray<uint64_t> array;
+	size_t numElements = 40 * ChunkedArray<uint64_t>::chunkSize;
+	std::atomic<bool> done(false);
+	std::atomic<size_t> numTorn(0);
+
+	auto read = [&]()
+	{
+		size_t checked = 0;
+
+		while (!done.load() || checked < array.size())
+		{
+			size_t size = array.size();
+
+			for (; checked < size; checked++)
+			{
+				if (array[checked] != checked * 0x9E3779B97F4A7C15ull)
+				{
+					numTorn++;
+				}
+			}
+		}
+	};
+
+	std::vector<std::thread> readers;
+
+	for (int reader = 0; reader < 4; reader++)
+	{
+		readers.emplace_back(read);
+	}
+
+	for (uint64_t element = 0; element < numElements; element++)
+	{
+		array.push_back(element * 0x9E3779B97F4A7C15ull);
+	}
+
+	done = true;
+
+	for (std::thread& reader : readers)
+	{
+		reader.join();
+	}
+
+	CHECK(array.size() == numElements);
+	CHECK(numTorn == 0);
+}
+
+void runChunkedArrayTests()
+{
+	testAppend();
+	testConcurrentReaders();
+}
@@ -0,0 +1,184 @@
+#include "Test.h"
+#include "CompactPrimeStore.h"
+#include "PrimeStore.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+	Returns every prime below limit, found with a plain sieve of Eratosthenes.
+*/
+static std::vector<uint64_t> findSmallPrimes(uint64_t limit)
+{
+	std::vector<uint64_t> primes;
+	std::vector<bool> composite(size_t(limit), false);
+
+	for (uint64_t number = 2; number < limit; number++)
+	{
+		if (!composite[size_t(number)])
+		{
+			primes.push_back(number);
+
+			for (uint64_t multiple = number * number; multiple < limit; multiple += number)
+			{
+				composite[size_t(multiple)] = true;
+			}
+		}
+	}
+
+	return primes;
+}
+
+/**
+	Returns every prime from low up to but not including low + width. The small
+	primes have to reach the square root of the end of the window.
+*/
+static std::vector<uint64_t> findPrimesInWindow(uint64_t low, uint64_t width, const std::vector<uint64_t>& smallPrimes)
+{
+	std::vector<uint64_t> primes;
+	std::vector<bool> composite(size_t(width), false);
+
+	for (uint64_t prime : smallPrimes)
+	{
+		if (prime * prime >= low + width)
+		{
+			break;
+		}
+
+		for (uint64_t multiple = std::max(prime * prime, (low + prime - 1) / prime * prime); multiple < low + width; multiple += prime)
+		{
+			composite[size_t(multiple - low)] = true;
+		}
+	}
+
+	for (uint64_t offset = 0; offset < width; offset++)
+	{
+		if (!composite[size_t(offset)] && low + offset > 1)
+		{
+			primes.push_back(low + offset);
+		}
+	}
+
+	return primes;
+}
+
+/**
+	Fills a PrimeStore and a CompactPrimeStore with the same primes and checks that
+	the compact store gives the same primes by index, by iterating from begin() and
+	by stepping back and forth across every sample boundary.
+*/
+template <typename P>
+static void compareWithPrimeStore(const std::vector<uint64_t>& primes)
+{
+	PrimeStore<P> store;
+	CompactPrimeStore<P> compact;
+
+	for (uint64_t prime : primes)
+	{
+		store.push_back(P(prime));
+		compact.push_back(P(prime));
+	}
+
+	size_t size = store.size();
+
+	CHECK(compact.size() == size);
+	CHECK(size_t(compact.end() - compact.begin()) == size);
+	CHECK(compact.back() == store[size - 1]);
+
+	bool indexed = true;
+
+	for (size_t index = 0; index < size; index++)
+	{
+		indexed &= compact[index] == store[index];
+	}
+
+	CHECK(indexed);
+
+	bool iterated = true;
+	size_t position = 0;
+
+	for (auto iter = compact.begin(); iter != compact.end(); ++iter, position++)
+	{
+		iterated &= position < size && *iter == store[position];
+	}
+
+	CHECK(iterated && position == size);
+
+	/*
+		The last prime of a sample interval, the sampled prime after it, and the one
+		after that, reached by jumping and by stepping.
+	*/
+	const size_t interval = CompactPrimeStore<P>::sampleInterval;
+	bool stepped = true;
+
+	for (size_t sample = interval; sample < size; sample += interval)
+	{
+		for (size_t index = sample - 1; index <= sample + 1 && index < size; index++)
+		{
+			auto iter = compact.begin() + std::ptrdiff_t(index);
+
+			stepped &= *iter == store[index];
+			stepped &= *(iter - 1) == store[index - 1];
+
+			if (index + 1 < size)
+			{
+				auto next = iter;
+				stepped &= *++next == store[index + 1];
+				stepped &= *--next == store[index];
+			}
+
+			auto previous = iter;
+			stepped &= *--previous == store[index - 1];
+			stepped &= *++previous == store[index];
+		}
+	}
+
+	CHECK(stepped);
+}
+
+/**
+	The first million primes, whose halved gaps all fit in a byte, and then primes
+	just below 2^32, which are a gap of billions away from them.
+*/
+static void testSmallPrimes(const std::vector<uint64_t>& smallPrimes)
+{
+	std::vector<uint64_t> primes(smallPrimes.begin(), smallPrimes.begin() + 1000000);
+	std::vector<uint64_t> top = findPrimesInWindow((uint64_t(1) << 32) - 2000, 2000, smallPrimes);
+
+	primes.insert(primes.end(), top.begin(), top.end());
+
+	compareWithPrimeStore<uint32_t>(primes);
+}
+
+/**
+	64-bit primes around 2^32 and near 2^40 and 2^48. The first jump lands exactly on
+	a sampled prime and the others within a sample interval, and each one is stored
+	as a multi-byte difference.
+*/
+static void testLargePrimes(const std::vector<uint64_t>& smallPrimes)
+{
+	std::vector<uint64_t> primes(smallPrimes.begin(), smallPrimes.begin() + 16 * CompactPrimeStore<uint64_t>::sampleInterval);
+
+	for (uint64_t low : { (uint64_t(1) << 32) - 2000, uint64_t(1) << 40, uint64_t(1) << 48 })
+	{
+		std::vector<uint64_t> window = findPrimesInWindow(low, 4000, smallPrimes);
+		primes.insert(primes.end(), window.begin(), window.end());
+	}
+
+	CHECK(primes.back() > (uint64_t(1) << 48));
+
+	compareWithPrimeStore<uint64_t>(primes);
+}
+
+void runCompactPrimeStoreTests()
+{
+	/*
+		The small primes reach 2^24, enough to sieve the windows just above 2^48.
+	*/
+	std::vector<uint64_t> smallPrimes = findSmallPrimes(uint64_t(1) << 24);
+
+	testSmallPrimes(smallPrimes);
+	testLargePrimes(smallPrimes);
+}
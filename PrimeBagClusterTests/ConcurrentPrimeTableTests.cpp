@@ -0,0 +1,212 @@
+#include "Test.h"
+#include "ConcurrentPrimeTable.h"
+
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+/**
+	Adds overlapping ranges of values from several threads and checks that every
+	value got exactly one prime, that every thread was given that prime, and that
+	the primes are the first ones of the source without gaps.
+*/
+static void testParallelAdd()
+{
+	const int numThreads = 4;
+	const uint32_t numValues = 200000;
+
+	ConcurrentPrimeTable<std::string> table(std::make_shared<PrimeSource<uint32_t>>(), 16);
+
+	/*
+		Each thread adds every value in a different order, so that the threads race
+		for the same values.
+	*/
+	std::vector<std::vector<uint32_t>> primes(numThreads, std::vector<uint32_t>(numValues));
+	std::vector<std::thread> threads;
+
+	for (int thread = 0; thread < numThreads; thread++)
+	{
+		threads.emplace_back([&, thread]()
+		{
+			for (uint32_t step = 0; step < numValues; step++)
+			{
+				uint32_t value = (step * 7919u + uint32_t(thread) * 104729u) % numValues;
+
+				primes[thread][value] = table.add(std::to_string(value));
+			}
+		});
+	}
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	CHECK(table.size() == numValues);
+
+	bool agree = true;
+	bool found = true;
+	std::set<uint32_t> distinct;
+
+	for (uint32_t value = 0; value < numValues; value++)
+	{
+		std::string key = std::to_string(value);
+		uint32_t prime = table.getPrime(key);
+
+		for (int thread = 0; thread < numThreads; thread++)
+		{
+			agree &= primes[thread][value] == prime;
+		}
+
+		found &= prime && table.containsPrime(prime) && table.getValue(prime) == key;
+		distinct.insert(prime);
+	}
+
+	CHECK(agree);
+	CHECK(found);
+	CHECK(distinct.size() == numValues);
+
+	const PrimeStore<uint32_t>& calculated = table.getPrimeNumbers();
+
+	CHECK(*distinct.begin() == 2);
+	CHECK(*distinct.rbegin() == calculated[numValues - 1]);
+	CHECK(!table.containsPrime(calculated[numValues]));
+	CHECK(!table.containsPrime(4));
+}
+
+/**
+	Reads the table while other threads add to it. A reader either does not find a
+	value yet or finds the prime it keeps, and the value of a prime it finds is
+	fully written.
+*/
+static void testReadWhileAdding()
+{
+	const int numWriters = 4;
+	const uint64_t numValues = 100000;
+
+	ConcurrentPrimeTable<uint64_t, uint64_t> table(std::make_shared<PrimeSource<uint64_t>>());
+	std::atomic<int> numRunning(numWriters);
+	std::atomic<size_t> numInconsistent(0);
+
+	std::vector<std::thread> threads;
+
+	for (int writer = 0; writer < numWriters; writer++)
+	{
+		threads.emplace_back([&, writer]()
+		{
+			for (uint64_t value = uint64_t(writer); value < numValues; value += numWriters)
+			{
+				table.add(value * value + 1);
+			}
+
+			numRunning--;
+		});
+	}
+
+	threads.emplace_back([&]()
+	{
+		std::vector<uint64_t> seen(numValues, 0);
+
+		while (numRunning)
+		{
+			for (uint64_t value = 0; value < numValues; value += 97)
+			{
+				uint64_t prime = table.getPrime(value * value + 1);
+
+				if (!prime)
+				{
+					continue;
+				}
+
+				if ((seen[value] && seen[value] != prime) || table.getValue(prime) != value * value + 1)
+				{
+					numInconsistent++;
+				}
+
+				seen[value] = prime;
+			}
+		}
+	});
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	CHECK(numInconsistent == 0);
+	CHECK(table.size() == numValues);
+
+	/*
+		Adding a value again returns the prime it already has.
+	*/
+	uint64_t prime = table.getPrime(uint64_t(1));
+
+	CHECK(prime && table.add(1) == prime);
+	CHECK(table.size() == numValues);
+}
+
+/**
+	A source that has run out of primes makes adding a new value throw, and leaves
+	the table as it was: the values already added keep their primes, and adding
+	again throws the same way instead of skipping over indices.
+*/
+static void testOverflow()
+{
+	std::string path = (std::filesystem::temp_directory_path() / "ConcurrentPrimeTableTests.primes").string();
+
+	/*
+		A prime file that claims every 32-bit number is tested, so the source has no
+		primes past the ones in it.
+	*/
+	PrimeStore<uint32_t> store;
+
+	for (uint32_t prime : { 2, 3, 5, 7 })
+	{
+		store.push_back(prime);
+	}
+
+	PrimeFile::write(path, store, UINT32_MAX);
+
+	ConcurrentPrimeTable<std::string> table(std::make_shared<PrimeSource<uint32_t>>(PrimeFile::open(path)), 4);
+
+	for (const char* value : { "a", "b", "c", "d" })
+	{
+		table.add(value);
+	}
+
+	int numThrown = 0;
+
+	for (int attempt = 0; attempt < 3; attempt++)
+	{
+		try
+		{
+			table.add("e");
+		}
+		catch (const std::overflow_error&)
+		{
+			numThrown++;
+		}
+	}
+
+	CHECK(numThrown == 3);
+	CHECK(table.size() == 4 && table.getPrime("e") == 0);
+	CHECK(table.getPrime("a") == 2 && table.getPrime("d") == 7 && table.add("c") == 5);
+	CHECK(table.getPrimeIndex(7) == 3 && table.containsIndex(3) && !table.containsIndex(4));
+	CHECK(table.getValueAt(3) == "d");
+
+	std::remove(path.c_str());
+}
+
+void runConcurrentPrimeTableTests()
+{
+	testParallelAdd();
+	testReadWhileAdding();
+	testOverflow();
+}
@@ -0,0 +1,403 @@
+#include "Test.h"
+#include "PrimeBag.h"
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+typedef PrimeTable<std::string> StringTable;
+typedef PrimeBag<std::string> StringBag;
+
+/**
+	A value held by a bag cannot be removed from the table, so its prime is not
+	handed to another value while the bag still decodes to it.
+*/
+static void testRemoveReferencedValue()
+{
+	StringTable table;
+	StringBag bag(&table);
+
+	bag.add("a");
+	bag.add("b");
+
+	CHECK(table.remove("a") == 0);
+	CHECK(table.getReferenceCount("a") == 1);
+
+	table.add("c");
+
+	std::vector<std::string> values;
+
+	for (const std::string& value : bag)
+	{
+		values.push_back(value);
+	}
+
+	CHECK((values == std::vector<std::string>{ "a", "b" }));
+
+	/*
+		Copies hold references of their own, and moving a bag hands its references
+		over.
+	*/
+	{
+		StringBag copy(bag);
+		StringBag moved(std::move(copy));
+
+		CHECK(table.getReferenceCount("a") == 2);
+		CHECK(copy.size() == 0 && moved.size() == 2);
+	}
+
+	CHECK(table.getReferenceCount("a") == 1);
+
+	/*
+		Once the last bag lets go of a value, the table removes it.
+	*/
+	bag.remove("a");
+
+	CHECK(table.getPrime("a") == 0);
+	CHECK(table.getPrime("c") != 0);
+}
+
+/**
+	A bag whose primes were taken from it by clearing the table reports it rather
+	than reading past its factors.
+*/
+static void testClearedTable()
+{
+	StringTable table;
+	StringBag bag(&table);
+
+	bag.add("a");
+	bag.add("b");
+	table.clear();
+
+	bool thrown = false;
+
+	try
+	{
+		for (const std::string& value : bag)
+		{
+			CHECK(!value.empty());
+		}
+	}
+	catch (const std::out_of_range&)
+	{
+		thrown = true;
+	}
+
+	CHECK(thrown);
+}
+
+/**
+	A small bag keeps its product inline and has no factor list, however it is
+	filled, copied or emptied again.
+*/
+static void testSmallBagDoesNotAllocate()
+{
+	StringTable table;
+	StringBag bag(&table);
+
+	for (const char* value : { "a", "b", "c", "d", "e", "f", "g", "h", "a", "b" })
+	{
+		bag.add(value);
+	}
+
+	StringBag copy(bag);
+	copy.add(bag);
+	copy.remove("c");
+
+	CHECK(bag.size() == 10 && copy.size() == 19);
+	CHECK(!bag.isSparse() && bag.getFactorCapacity() == 0 && bag.hash == 1);
+	CHECK(!copy.isSparse() && copy.getFactorCapacity() == 0 && copy.hash == 1);
+
+	bag.clear();
+
+	CHECK(bag.getFactorCapacity() == 0 && table.getReferenceCount("a") == 4);
+}
+
+/**
+	Bags in both forms are re-encoded when their table compacts and reranks, and
+	once they are gone the table has released every value they held.
+*/
+static void testRemap()
+{
+	StringTable table;
+	table.enableReranking();
+
+	{
+		StringBag product(&table);
+		StringBag sparse(&table);
+		sparse.setFormThresholds(0, 0);
+
+		{
+			StringBag holes(&table);
+
+			for (const char* value : { "a", "b", "c", "d", "e", "f" })
+			{
+				holes.add(value);
+			}
+
+			product.add("e");
+			product.add("f");
+			product.add("f");
+			sparse.add("c");
+			sparse.add("f");
+		}
+
+		CHECK(table.size() == 3);
+
+		table.compact();
+
+		CHECK(table.getPrime("c") == 2 && table.getPrime("e") == 3 && table.getPrime("f") == 5);
+
+		table.rerank();
+
+		CHECK(table.getPrime("f") == 2);
+
+		std::vector<std::string> productValues = product.asVector();
+		std::vector<std::string> sparseValues = sparse.asVector();
+		std::sort(productValues.begin(), productValues.end());
+		std::sort(sparseValues.begin(), sparseValues.end());
+
+		CHECK((productValues == std::vector<std::string>{ "e", "f", "f" }));
+		CHECK((sparseValues == std::vector<std::string>{ "c", "f" }));
+		CHECK(!product.isSparse() && sparse.isSparse());
+		CHECK(product.count("f") == 2 && sparse.count("f") == 1 && !sparse.contains("e"));
+		CHECK(table.getReferenceCount("f") == 3);
+	}
+
+	CHECK(table.size() == 0);
+}
+
+/**
+	Runs random operations on a few bags and on a multiset model of each one, and
+	compares the bags, the reference counts of the table and which values it keeps
+	with the models. Two of the bags start with thresholds low enough that they
+	switch to the sparse form, and assigning bags to each other passes the
+	thresholds around.
+*/
+static void testAgainstModel()
+{
+	const size_t numBags = 4;
+	const size_t numWords = 40;
+
+	StringTable table;
+	std::vector<StringBag> bags;
+	std::vector<std::map<std::string, uint>> models(numBags);
+	std::vector<std::string> words;
+
+	bags.reserve(numBags);
+
+	for (size_t bag = 0; bag < numBags; bag++)
+	{
+		bags.emplace_back(&table);
+	}
+
+	bags[2].setFormThresholds(96, 6);
+	bags[3].setFormThresholds(0, 0);
+
+	for (size_t word = 0; word < numWords; word++)
+	{
+		words.push_back("word" + std::to_string(word));
+	}
+
+	std::mt19937 random(42);
+	bool consistent = true;
+	bool sawSparse = false;
+
+	auto modelSize = [&](size_t bag)
+	{
+		uint size = 0;
+
+		for (const auto& entry : models[bag])
+		{
+			size += entry.second;
+		}
+
+		return size;
+	};
+
+	for (int step = 0; step < 20000 && consistent; step++)
+	{
+		size_t target = random() % numBags;
+		size_t other = random() % numBags;
+		const std::string& word = words[random() % (step < 10000 ? 10 : numWords)];
+
+		switch (random() % 10)
+		{
+		case 0:
+		case 1:
+		case 2:
+		case 3:
+			bags[target].add(word);
+			models[target][word]++;
+			break;
+
+		case 4:
+		case 5:
+		{
+			bool contained = models[target].count(word) > 0;
+
+			consistent &= bags[target].remove(word) == contained;
+
+			if (contained && !--models[target][word])
+			{
+				models[target].erase(word);
+			}
+
+			break;
+		}
+
+		case 6:
+		{
+			/*
+				Adding bags to each other would grow them exponentially, so it stops
+				once they are large enough to have left the product form. The other
+				bag may be the target itself.
+			*/
+			if (modelSize(target) + modelSize(other) <= 64)
+			{
+				std::map<std::string, uint> added = models[other];
+
+				bags[target].add(bags[other]);
+
+				for (const auto& entry : added)
+				{
+					models[target][entry.first] += entry.second;
+				}
+			}
+
+			break;
+		}
+
+		case 7:
+		{
+			std::map<std::string, uint> removed = models[other];
+			bool contained = true;
+
+			for (const auto& entry : removed)
+			{
+				contained &= models[target].count(entry.first) && models[target][entry.first] >= entry.second;
+			}
+
+			consistent &= bags[target].remove(bags[other]) == contained;
+
+			if (contained)
+			{
+				for (const auto& entry : removed)
+				{
+					if (!(models[target][entry.first] -= entry.second))
+					{
+						models[target].erase(entry.first);
+					}
+				}
+			}
+
+			break;
+		}
+
+		case 8:
+			if (target != other)
+			{
+				bags[target] = bags[other];
+				models[target] = models[other];
+			}
+
+			break;
+
+		default:
+			if (random() % 4 == 0)
+			{
+				bags[target].clear();
+				models[target].clear();
+			}
+			else
+			{
+				StringBag copy(bags[target]);
+				bags[target] = std::move(copy);
+			}
+
+			break;
+		}
+
+		for (size_t bag = 0; bag < numBags && consistent; bag++)
+		{
+			std::vector<std::string> expected;
+
+			for (const auto& entry : models[bag])
+			{
+				expected.insert(expected.end(), entry.second, entry.first);
+			}
+
+			std::vector<std::string> actual = bags[bag].asVector();
+			std::sort(actual.begin(), actual.end());
+
+			consistent &= bags[bag].size() == modelSize(bag) && actual == expected;
+			sawSparse |= bags[bag].isSparse();
+			consistent &= bags[bag].count(word) == (models[bag].count(word) ? models[bag][word] : 0);
+		}
+
+		for (const std::string& value : words)
+		{
+			uint references = 0;
+
+			for (size_t bag = 0; bag < numBags; bag++)
+			{
+				references += models[bag].count(value) ? models[bag][value] : 0;
+			}
+
+			consistent &= table.getReferenceCount(value) == references && (table.getPrime(value) != 0) == (references != 0);
+		}
+	}
+
+	CHECK(consistent);
+	CHECK(sawSparse);
+}
+
+/**
+	A bag that is added to or removed from itself counts the references of its
+	values once for every time they are in it.
+*/
+static void testSelfAddRemove()
+{
+	StringTable table;
+
+	for (size_t maxProductLength : { size_t(100), size_t(0) })
+	{
+		{
+			StringBag bag(&table);
+			bag.setFormThresholds(maxProductLength, uint(maxProductLength));
+			bag.add("1");
+			bag.add("2");
+
+			bag.add(bag);
+
+			CHECK(bag.size() == 4 && bag.count("1") == 2 && bag.count("2") == 2);
+			CHECK(table.getReferenceCount("1") == 2 && table.getReferenceCount("2") == 2);
+
+			CHECK(bag.remove(bag));
+
+			CHECK(bag.size() == 0 && bag.count("1") == 0);
+			CHECK(table.getReferenceCount("1") == 0 && table.getPrime("1") == 0);
+
+			bag.add("1");
+			bag.add("2");
+		}
+
+		CHECK(table.getReferenceCount("1") == 0 && table.getReferenceCount("2") == 0);
+		CHECK(table.size() == 0);
+	}
+}
+
+void runPrimeBagTests()
+{
+	testRemoveReferencedValue();
+	testSmallBagDoesNotAllocate();
+	testSelfAddRemove();
+	testClearedTable();
+	testRemap();
+	testAgainstModel();
+}
@@ -0,0 +1,110 @@
+#include "Test.h"
+#include "SieveOfEratosthenes.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+
+/**
+	A sieve saves and reopens the same primes, and continues sieving after them.
+	This includes a sieve that has not found any primes yet.
+*/
+static void testSaveAndOpen()
+{
+	std::string path = (std::filesystem::temp_directory_path() / "PrimeFileTests.primes").string();
+
+	for (size_t numPrimes : { size_t(0), size_t(1), size_t(1000) })
+	{
+		{
+			SieveOfEratosthenes<uint32_t> sieve;
+
+			if (numPrimes)
+			{
+				sieve.getPrimeNumber(numPrimes - 1);
+			}
+
+			sieve.save(path);
+		}
+
+		std::shared_ptr<const PrimeFile> file = PrimeFile::open(path);
+
+		CHECK(file->getNumPrimes() >= numPrimes);
+		CHECK(!numPrimes == !file->getNumPrimes());
+
+		SieveOfEratosthenes<uint32_t> reopened(file);
+		SieveOfEratosthenes<uint32_t> expected;
+
+		CHECK(reopened.getPrimeNumber(0) == 2);
+		CHECK(reopened.getPrimeNumber(1999) == expected.getPrimeNumber(1999));
+
+		for (size_t index = 0; index < 2000; index++)
+		{
+			if (!CHECK(reopened.getCalculatedPrimes()[index] == expected.getCalculatedPrimes()[index]))
+			{
+				break;
+			}
+		}
+	}
+
+	std::remove(path.c_str());
+}
+
+/**
+	Saving over a prime file replaces it with the new primes, and leaves no
+	temporary file behind. A save that cannot be written throws.
+*/
+static void testReplaceFile()
+{
+	std::filesystem::path directory = std::filesystem::temp_directory_path();
+	std::string path = (directory / "PrimeFileTests-replace.primes").string();
+
+	SieveOfEratosthenes<uint32_t> small, large;
+	small.getPrimeNumber(10);
+	large.getPrimeNumber(5000);
+
+	small.save(path);
+
+	{
+		std::shared_ptr<const PrimeFile> file = PrimeFile::open(path);
+		size_t numPrimes = file->getNumPrimes();
+
+#ifndef _WIN32
+		/*
+			A file that is mapped keeps its primes while it is replaced. Windows does
+			not replace a mapped file.
+		*/
+		large.save(path);
+
+		CHECK(file->getNumPrimes() == numPrimes && file->getPrimes<uint32_t>()[numPrimes - 1] == small.getCalculatedPrimes()[numPrimes - 1]);
+#else
+		CHECK(numPrimes == small.getCalculatedPrimes().size());
+#endif
+	}
+
+	large.save(path);
+
+	CHECK(!std::filesystem::exists(path + ".tmp"));
+	CHECK(PrimeFile::open(path)->getNumPrimes() == large.getCalculatedPrimes().size());
+
+	bool thrown = false;
+
+	try
+	{
+		small.save((directory / "PrimeFileTests-missing" / "sieve.primes").string());
+	}
+	catch (const std::runtime_error&)
+	{
+		thrown = true;
+	}
+
+	CHECK(thrown);
+
+	std::remove(path.c_str());
+}
+
+void runPrimeFileTests()
+{
+	testSaveAndOpen();
+	testReplaceFile();
+}
@@ -0,0 +1,214 @@
+#include "Test.h"
+#include "PrimeLookahead.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/**
+	Pops primes through a small buffer, so that the consumer overtakes the producer
+	and both sides have to wake each other, and compares them with the source.
+*/
+static void testPopInOrder()
+{
+	PrimeSource<uint32_t> source;
+	PrimeLookahead<uint32_t, PrimeStore<uint32_t>> lookahead(source, 4, 1);
+
+	bool inOrder = true;
+	size_t numPrimes = 100000;
+
+	for (size_t index = 0; index < numPrimes; index++)
+	{
+		uint32_t prime = lookahead.pop();
+
+		inOrder &= index < source.getCalculatedPrimes().size() && prime == source.getCalculatedPrimes()[index];
+	}
+
+	CHECK(inOrder);
+	CHECK(source.getCalculatedPrimes()[0] == 2);
+	CHECK(source.getCalculatedPrimes()[numPrimes - 1] == 1299709);
+
+	PrimeLookaheadStatistics statistics = lookahead.getStatistics();
+
+#ifndef PRIMEBAG_NO_STATISTICS
+	CHECK(statistics.numPopped == numPrimes);
+	CHECK(statistics.numProduced >= numPrimes);
+	CHECK(statistics.stallTimes.count == statistics.numStalls);
+#else
+	CHECK(statistics.numPopped == 0);
+#endif
+}
+
+/**
+	Restarting discards the buffered primes and continues at the given index, both
+	before and after the producer has started.
+*/
+static void testRestart()
+{
+	PrimeSource<uint64_t> source;
+	PrimeLookahead<uint64_t, PrimeStore<uint64_t>> lookahead(source);
+
+	lookahead.restart(10);
+	CHECK(lookahead.pop() == 31);
+
+	for (int count = 0; count < 1000; count++)
+	{
+		lookahead.pop();
+	}
+
+	lookahead.restart(3);
+	CHECK(lookahead.pop() == 7);
+	CHECK(lookahead.pop() == 11);
+
+	lookahead.restart(0);
+	CHECK(lookahead.pop() == 2);
+}
+
+/**
+	Two lookaheads on one source hand out the same primes independently, and share
+	the producer of the source.
+*/
+static void testSharedSource()
+{
+	PrimeSource<uint32_t> source;
+	PrimeLookahead<uint32_t, PrimeStore<uint32_t>> first(source, 8, 2);
+	PrimeLookahead<uint32_t, PrimeStore<uint32_t>> second(source, 8, 2);
+
+	bool same = true;
+
+	for (int count = 0; count < 20000; count++)
+	{
+		same &= first.pop() == second.pop();
+	}
+
+	CHECK(same);
+	CHECK(first.getProducer() == second.getProducer());
+
+	PrimeSource<uint32_t> otherSource;
+	PrimeLookahead<uint32_t, PrimeStore<uint32_t>> other(otherSource);
+
+	CHECK(other.getProducer() != first.getProducer());
+}
+
+/**
+	Many lookaheads on one source are refilled by its one producer in turn, and
+	each hands out every prime in order.
+*/
+static void testManyLookaheads()
+{
+	PrimeSource<uint32_t> source;
+	std::vector<std::unique_ptr<PrimeLookahead<uint32_t, PrimeStore<uint32_t>>>> lookaheads;
+
+	for (int lookahead = 0; lookahead < 200; lookahead++)
+	{
+		lookaheads.push_back(std::make_unique<PrimeLookahead<uint32_t, PrimeStore<uint32_t>>>(source, 4, 1));
+	}
+
+	bool inOrder = true;
+
+	for (size_t index = 0; index < 500; index++)
+	{
+		for (auto& lookahead : lookaheads)
+		{
+			inOrder &= lookahead->pop() == source.getCalculatedPrimes()[index];
+		}
+
+		/*
+			Dropping lookaheads while the others are refilled must not disturb them.
+		*/
+		if (index % 100 == 99)
+		{
+			lookaheads.resize(lookaheads.size() / 2);
+		}
+	}
+
+	CHECK(inOrder);
+}
+
+/**
+	Returns whether the next pop throws because the source ran out of primes.
+*/
+static bool popThrows(PrimeLookahead<uint32_t, PrimeStore<uint32_t>>& lookahead)
+{
+	try
+	{
+		lookahead.pop();
+	}
+	catch (const std::overflow_error&)
+	{
+		return true;
+	}
+
+	return false;
+}
+
+/**
+	A pop that reaches a prime the source cannot calculate throws, and the next pop
+	tries the same prime again rather than skipping it. A small buffer with a high
+	watermark queues another refill while the one that fails is running, which must
+	not move the lookahead past the failed prime. After a restart, the pops of
+	primes the source has succeed again.
+*/
+static void testSourceError()
+{
+	std::string path = (std::filesystem::temp_directory_path() / "PrimeLookaheadTests.primes").string();
+
+	/*
+		A prime file that claims every 32-bit number is tested, so the source has no
+		primes past the ones in it.
+	*/
+	PrimeStore<uint32_t> store;
+
+	for (uint32_t prime : { 2, 3, 5, 7 })
+	{
+		store.push_back(prime);
+	}
+
+	PrimeFile::write(path, store, UINT32_MAX);
+
+	PrimeSource<uint32_t> source(PrimeFile::open(path));
+	PrimeLookahead<uint32_t, PrimeStore<uint32_t>> lookahead(source, 4, 3);
+
+	lookahead.restart(4);
+
+	CHECK(popThrows(lookahead));
+	CHECK(popThrows(lookahead));
+
+	bool recovered = true;
+
+	for (int round = 0; round < 100; round++)
+	{
+		lookahead.restart(round % 4);
+
+		for (uint32_t prime : { 2, 3, 5, 7 })
+		{
+			if (prime >= store[round % 4])
+			{
+				recovered &= lookahead.pop() == prime;
+			}
+		}
+
+		recovered &= popThrows(lookahead) && popThrows(lookahead);
+	}
+
+	CHECK(recovered);
+
+	lookahead.restart(1);
+
+	CHECK(lookahead.pop() == 3);
+
+	std::remove(path.c_str());
+}
+
+void runPrimeLookaheadTests()
+{
+	testPopInOrder();
+	testRestart();
+	testSharedSource();
+	testManyLookaheads();
+	testSourceError();
+}
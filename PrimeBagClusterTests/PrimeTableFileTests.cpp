@@ -0,0 +1,444 @@
+#include "Test.h"
+#include "PrimeTable.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+typedef PrimeTable<std::string> StringTable;
+
+static std::string readFile(const std::string& path)
+{
+	std::ifstream stream(path, std::ios::binary);
+
+	return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+}
+
+static void writeFile(const std::string& path, const std::string& bytes)
+{
+	std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+	stream.write(bytes.data(), std::streamsize(bytes.size()));
+}
+
+template <typename Word>
+static Word getWord(const std::string& bytes, size_t position)
+{
+	Word word;
+	memcpy(&word, bytes.data() + position, sizeof(word));
+
+	return word;
+}
+
+template <typename Word>
+static void setWord(std::string& bytes, size_t position, Word word)
+{
+	memcpy(&bytes[position], &word, sizeof(word));
+}
+
+/**
+	Writes a file with the checksum of its bytes, so that only the consistency of
+	its sections can reject it.
+*/
+static void writeWithChecksum(const std::string& path, std::string bytes)
+{
+	uint64_t hash = 14695981039346656037ull;
+
+	for (size_t position = sizeof(PrimeTableFileHeader); position < bytes.size(); position++)
+	{
+		hash ^= uint8_t(bytes[position]);
+		hash *= 1099511628211ull;
+	}
+
+	setWord<uint64_t>(bytes, offsetof(PrimeTableFileHeader, checksum), hash);
+	writeFile(path, bytes);
+}
+
+/**
+	Returns whether opening the file and verifying it throws.
+*/
+static bool isRejected(const std::string& path)
+{
+	try
+	{
+		PrimeTableFile::open(path);
+	}
+	catch (const std::runtime_error&)
+	{
+		return true;
+	}
+
+	return false;
+}
+
+/**
+	Returns whether restoring a table from the file, or looking up the given number
+	of saved values in it, throws. Opening the file without verifying it must not.
+*/
+static bool isReadRejected(const std::string& path, int numValues)
+{
+	std::shared_ptr<const PrimeTableFile> file = PrimeTableFile::open(path, false);
+
+	try
+	{
+		StringTable restored{ PrimeTableView<std::string>(file) };
+	}
+	catch (const std::runtime_error&)
+	{
+		return true;
+	}
+
+	try
+	{
+		PrimeTableView<std::string> view(file);
+
+		for (int i = 0; i < numValues; i++)
+		{
+			view.getPrime("value" + std::to_string(i));
+		}
+	}
+	catch (const std::runtime_error&)
+	{
+		return true;
+	}
+
+	return false;
+}
+
+/**
+	A file whose sections contradict each other is rejected when it is verified.
+	Without verification it still opens, but reading the words that are out of
+	bounds throws, since lookups and value reads trust the sections.
+*/
+static void testCorruptSections()
+{
+	std::string path = (std::filesystem::temp_directory_path() / "PrimeTableFileTests.tab").string();
+
+	{
+		StringTable table;
+
+		for (int i = 0; i < 100; i++)
+		{
+			table.add("value" + std::to_string(i));
+		}
+
+		table.remove("value3");
+		table.remove("value40");
+		table.save(path);
+	}
+
+	std::string original = readFile(path);
+	const PrimeTableFileHeader& header = *reinterpret_cast<const PrimeTableFileHeader*>(original.data());
+
+	CHECK(header.numIndices == 100 && header.numHoles == 2 && header.wordSize == 4);
+
+	size_t offsetsStart = sizeof(PrimeTableFileHeader);
+	size_t holesStart = offsetsStart + size_t(header.numIndices + 1) * 8;
+	size_t slotsStart = holesStart + 8;
+
+	/*
+		The saved file opens, and gives the primes the table had.
+	*/
+	{
+		StringTable restored(PrimeTableView<std::string>(PrimeTableFile::open(path)));
+
+		CHECK(restored.size() == 98);
+		CHECK(restored.getPrime("value3") == 0);
+		CHECK(restored.getPrime("value99") == 541);
+	}
+
+	CHECK(!isRejected(path));
+	CHECK(!isReadRejected(path, 100));
+
+	/*
+		A changed byte fails the checksum.
+	*/
+	std::string bytes = original;
+	bytes.back() ^= 1;
+	writeFile(path, bytes);
+
+	CHECK(isRejected(path));
+
+	/*
+		An offset past the arena makes the offsets descend.
+	*/
+	bytes = original;
+	setWord<uint64_t>(bytes, offsetsStart + 8 * 10, header.arenaSize + 100);
+	writeWithChecksum(path, bytes);
+
+	CHECK(isRejected(path));
+	CHECK(isReadRejected(path, 100));
+
+	/*
+		A hole at the end of the indices, and the same hole twice.
+	*/
+	bytes = original;
+	setWord<uint32_t>(bytes, holesStart, uint32_t(header.numIndices));
+	writeWithChecksum(path, bytes);
+
+	CHECK(isRejected(path));
+	CHECK(isReadRejected(path, 100));
+
+	bytes = original;
+	setWord<uint32_t>(bytes, holesStart, getWord<uint32_t>(original, holesStart + 4));
+	writeWithChecksum(path, bytes);
+
+	CHECK(isRejected(path));
+	CHECK(isReadRejected(path, 100));
+
+	/*
+		A slot past the indices, a slot pointing at a hole, and a value that lost its
+		slot.
+	*/
+	size_t filledSlot = slotsStart;
+
+	while (!getWord<uint32_t>(original, filledSlot))
+	{
+		filledSlot += 4;
+	}
+
+	bytes = original;
+	setWord<uint32_t>(bytes, filledSlot, uint32_t(header.numIndices + 5));
+	writeWithChecksum(path, bytes);
+
+	CHECK(isRejected(path));
+	CHECK(isReadRejected(path, 100));
+
+	bytes = original;
+	setWord<uint32_t>(bytes, filledSlot, getWord<uint32_t>(original, holesStart) + 1);
+	writeWithChecksum(path, bytes);
+
+	CHECK(isRejected(path));
+
+	bytes = original;
+	setWord<uint32_t>(bytes, filledSlot, 0);
+	writeWithChecksum(path, bytes);
+
+	CHECK(isRejected(path));
+
+	/*
+		An index without an empty slot. Looking up a missing value gives up after
+		every slot instead of probing forever.
+	*/
+	bytes = original;
+
+	for (size_t slot = slotsStart; slot < slotsStart + 4 * header.numSlots; slot += 4)
+	{
+		if (!getWord<uint32_t>(bytes, slot))
+		{
+			setWord<uint32_t>(bytes, slot, 1);
+		}
+	}
+
+	writeWithChecksum(path, bytes);
+
+	CHECK(isRejected(path));
+	CHECK(PrimeTableView<std::string>(PrimeTableFile::open(path, false)).getPrime("missing") == 0);
+
+	std::remove(path.c_str());
+}
+
+/**
+	A value whose bytes were cut short, which leaves the sections consistent, is
+	rejected when it is decoded rather than read past the end of the file.
+*/
+static void testTruncatedValue()
+{
+	std::string path = (std::filesystem::temp_directory_path() / "PrimeTableFileTests-truncated.tab").string();
+
+	{
+		PrimeTable<uint32_t> table;
+
+		for (uint32_t i = 0; i < 10; i++)
+		{
+			table.add(i * 7);
+		}
+
+		table.save(path);
+	}
+
+	std::string bytes = readFile(path);
+	const PrimeTableFileHeader header = *reinterpret_cast<const PrimeTableFileHeader*>(bytes.data());
+	size_t lastOffset = sizeof(PrimeTableFileHeader) + size_t(header.numIndices - 1) * 8;
+
+	CHECK(header.arenaSize == 40);
+
+	/*
+		The last value keeps one byte, and the one before it grows by the rest.
+	*/
+	setWord<uint64_t>(bytes, lastOffset, header.arenaSize - 1);
+	writeWithChecksum(path, bytes);
+
+	std::shared_ptr<const PrimeTableFile> file = PrimeTableFile::open(path, false);
+	PrimeTableView<uint32_t> view(file);
+	int numThrown = 0;
+
+	for (size_t index : { size_t(header.numIndices - 2), size_t(header.numIndices - 1) })
+	{
+		try
+		{
+			view.getValueAt(index);
+		}
+		catch (const std::runtime_error&)
+		{
+			numThrown++;
+		}
+	}
+
+	CHECK(numThrown == 2);
+	CHECK(view.getValueAt(0) == 0 && view.getValueAt(1) == 7);
+
+	bool thrown = false;
+
+	try
+	{
+		PrimeTable<uint32_t> restored(view);
+	}
+	catch (const std::runtime_error&)
+	{
+		thrown = true;
+	}
+
+	CHECK(thrown);
+
+	/*
+		A string must have a whole number of characters.
+	*/
+	thrown = false;
+
+	try
+	{
+		ValueCodec<std::u16string>::decode(std::string_view("abc", 3));
+	}
+	catch (const std::runtime_error&)
+	{
+		thrown = true;
+	}
+
+	CHECK(thrown);
+
+	std::remove(path.c_str());
+}
+
+/**
+	A view on a source that has not calculated the primes of the table yet opens
+	without sieving, and its lookups calculate the primes and check them against
+	the file. A file whose last prime is not that of the source is only rejected
+	by the first lookup that needs it.
+*/
+static void testDeferredPrimeCheck()
+{
+	std::string path = (std::filesystem::temp_directory_path() / "PrimeTableFileTests-deferred.tab").string();
+
+	{
+		StringTable table;
+
+		for (int i = 0; i < 1000; i++)
+		{
+			table.add("value" + std::to_string(i));
+		}
+
+		table.save(path);
+	}
+
+	{
+		std::shared_ptr<PrimeSource<uint32_t>> source = std::make_shared<PrimeSource<uint32_t>>();
+		PrimeTableView<std::string> view(PrimeTableFile::open(path), source);
+
+		CHECK(source->getCalculatedPrimes().size() < 1000);
+		CHECK(view.getPrime("value1") == 3);
+		CHECK(view.getPrime("value999") == 7919);
+		CHECK(view.getPrimeIndex(7919) == 999 && view.getPrimeIndex(7907) == 998 && view.getPrimeIndex(7920) == 1000);
+	}
+
+	std::string bytes = readFile(path);
+	setWord<uint64_t>(bytes, offsetof(PrimeTableFileHeader, lastPrime), 7907);
+	writeFile(path, bytes);
+
+	std::shared_ptr<PrimeSource<uint32_t>> source = std::make_shared<PrimeSource<uint32_t>>();
+	PrimeTableView<std::string> view(PrimeTableFile::open(path), source);
+	bool thrown = false;
+
+	try
+	{
+		view.getPrime("value999");
+	}
+	catch (const std::runtime_error&)
+	{
+		thrown = true;
+	}
+
+	CHECK(thrown);
+
+	/*
+		Once the source has the primes, a new view is rejected right away.
+	*/
+	thrown = false;
+
+	try
+	{
+		PrimeTableView<std::string> checked(PrimeTableFile::open(path), source);
+	}
+	catch (const std::runtime_error&)
+	{
+		thrown = true;
+	}
+
+	CHECK(thrown);
+
+	std::remove(path.c_str());
+}
+
+/**
+	Saving over a table file replaces it with the new table, and leaves no
+	temporary file behind. A save that cannot be written throws.
+*/
+static void testReplaceFile()
+{
+	std::filesystem::path directory = std::filesystem::temp_directory_path();
+	std::string path = (directory / "PrimeTableFileTests-replace.tab").string();
+
+	StringTable first, second;
+	first.add("first");
+	second.add("second0");
+	second.add("second1");
+
+	first.save(path);
+	second.save(path);
+
+	CHECK(!std::filesystem::exists(path + ".tmp"));
+
+	{
+		PrimeTableView<std::string> view(PrimeTableFile::open(path));
+
+		CHECK(view.getPrime("first") == 0 && view.getPrime("second1") == 3);
+	}
+
+	bool thrown = false;
+
+	try
+	{
+		first.save((directory / "PrimeTableFileTests-missing" / "table.tab").string());
+	}
+	catch (const std::runtime_error&)
+	{
+		thrown = true;
+	}
+
+	CHECK(thrown);
+
+	std::remove(path.c_str());
+}
+
+void runPrimeTableFileTests()
+{
+	testCorruptSections();
+	testTruncatedValue();
+	testDeferredPrimeCheck();
+	testReplaceFile();
+}
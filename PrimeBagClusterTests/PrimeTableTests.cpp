@@ -0,0 +1,305 @@
+#include "Test.h"
+#include "PrimeBag.h"
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+typedef PrimeTable<std::string> StringTable;
+typedef PrimeBag<std::string> StringBag;
+
+/**
+	Returns the values of a bag in sorted order.
+*/
+static std::vector<std::string> getSortedValues(const StringBag& bag)
+{
+	std::vector<std::string> values = bag.asVector();
+	std::sort(values.begin(), values.end());
+
+	return values;
+}
+
+/**
+	Runs the same adds, removes and remappings on a table with each map policy. The
+	policy only decides how a value finds its index, so both tables have to hand out
+	the same primes.
+*/
+static void testMapPolicies()
+{
+	PrimeTable<std::string, uint32_t, PrimeStore<uint32_t>, FlatMapPolicy> flatTable;
+	PrimeTable<std::string, uint32_t, PrimeStore<uint32_t>, NodeMapPolicy> nodeTable;
+
+	flatTable.enableReranking();
+	nodeTable.enableReranking();
+
+	std::mt19937 random(13);
+	std::uniform_int_distribution<int> valueDistribution(0, 2999);
+
+	for (int i = 0; i < 50000; i++)
+	{
+		std::string value = std::to_string(valueDistribution(random));
+
+		if (random() % 4)
+		{
+			CHECK(flatTable.add(value) == nodeTable.add(value));
+		}
+		else
+		{
+			CHECK(flatTable.remove(value) == nodeTable.remove(value));
+		}
+
+		if (i % 20000 == 19999)
+		{
+			flatTable.rerank();
+			nodeTable.rerank();
+		}
+	}
+
+	flatTable.compact();
+	nodeTable.compact();
+
+	CHECK(flatTable.size() == nodeTable.size());
+	CHECK(flatTable.getNumIndices() == flatTable.size());
+
+	for (int i = 0; i < 3000; i++)
+	{
+		std::string value = std::to_string(i);
+		uint32_t prime = nodeTable.getPrime(std::string_view(value));
+
+		CHECK(flatTable.getPrime(value.c_str()) == prime);
+		CHECK(!prime || nodeTable.getValue(prime) == value);
+	}
+}
+
+/**
+	An addAll that runs out of primes leaves the table as it was, including the
+	usage and reference counts of the values that were in it already.
+*/
+static void testAddAllRollback()
+{
+	/*
+		The table gets every prime below 2^16 and then the largest prime below 2^32,
+		so that the sieve has nothing to hand out after it.
+	*/
+	std::vector<uint32_t> primeNumbers;
+	std::vector<bool> composite(65536);
+
+	for (uint32_t number = 2; number < 65536; number++)
+	{
+		if (!composite[number])
+		{
+			primeNumbers.push_back(number);
+
+			for (uint32_t multiple = number * number; multiple < 65536; multiple += number)
+			{
+				composite[multiple] = true;
+			}
+		}
+	}
+
+	primeNumbers.push_back(4294967291u);
+
+	PrimeTable<std::string> table(&primeNumbers);
+	size_t numValues = primeNumbers.size() - 1;
+
+	for (size_t i = 0; i < numValues; i++)
+	{
+		table.add(std::to_string(i));
+	}
+
+	table.addReference("1");
+	table.remove("5");
+	table.enableReranking();
+	table.add("1");
+	table.add("2");
+
+	/*
+		"new0" takes the hole at index 5, "new1" the last prime there is and "new2"
+		finds none.
+	*/
+	std::vector<std::string> input = { "1", "2", "2", "new0", "new1", "new1", "new2" };
+	std::vector<uint32_t> primes;
+	bool thrown = false;
+
+	try
+	{
+		table.addAll(input.begin(), input.end(), std::back_inserter(primes));
+	}
+	catch (const std::overflow_error&)
+	{
+		thrown = true;
+	}
+
+	CHECK(thrown);
+	CHECK(primes.empty());
+	CHECK(table.size() == numValues - 1);
+	CHECK(table.getNumIndices() == numValues);
+	CHECK(table.getUsageCount("1") == 1 && table.getUsageCount("2") == 1);
+	CHECK(table.getReferenceCount("1") == 1 && table.getReferenceCount("2") == 0);
+	CHECK(table.getPrime("new0") == 0 && table.getPrime("new1") == 0 && table.getPrime("new2") == 0);
+
+	/*
+		Without the value that finds no prime, the same add goes through, reuses the
+		hole first and counts the usage once.
+	*/
+	input.pop_back();
+	table.addAll(input.begin(), input.end(), std::back_inserter(primes));
+
+	CHECK((primes == std::vector<uint32_t>{ table.getPrime("1"), table.getPrime("2"), table.getPrime("2"), 13, 4294967291u, 4294967291u }));
+	CHECK(table.getUsageCount("1") == 2 && table.getUsageCount("2") == 3 && table.getUsageCount("new1") == 2);
+	CHECK(table.getReferenceCount("1") == 1);
+}
+
+/**
+	New values take the smallest free index first, whatever order the indices
+	were freed in, and only get a new prime once every hole is filled.
+*/
+static void testHoleOrder()
+{
+	std::vector<size_t> removed = { 2, 5, 7 };
+	bool smallestFirst = true;
+
+	do
+	{
+		StringTable table;
+
+		for (int i = 0; i < 10; i++)
+		{
+			table.add("value" + std::to_string(i));
+		}
+
+		for (size_t index : removed)
+		{
+			table.remove("value" + std::to_string(index));
+		}
+
+		smallestFirst &= table.add("new0") == 5 && table.add("new1") == 13 && table.add("new2") == 19;
+		smallestFirst &= table.add("new3") == 31 && table.getNumIndices() == 11;
+	}
+	while (std::next_permutation(removed.begin(), removed.end()));
+
+	CHECK(smallestFirst);
+}
+
+/**
+	Compacting moves the values down onto the holes in the order of their primes,
+	and returns the primes that moved. The bags of the table are re-encoded with
+	it, in both forms, and still hold the same values.
+*/
+static void testCompactRemapping()
+{
+	StringTable table;
+
+	for (int i = 0; i < 10; i++)
+	{
+		table.add("value" + std::to_string(i));
+	}
+
+	StringBag product(&table);
+	StringBag sparse(&table);
+	sparse.setFormThresholds(0, 0);
+
+	for (const char* value : { "value1", "value8", "value8", "value9" })
+	{
+		product.add(value);
+	}
+
+	for (const char* value : { "value3", "value9" })
+	{
+		sparse.add(value);
+	}
+
+	std::vector<std::string> productValues = getSortedValues(product);
+	std::vector<std::string> sparseValues = getSortedValues(sparse);
+
+	for (int i : { 0, 2, 4, 5, 6 })
+	{
+		table.remove("value" + std::to_string(i));
+	}
+
+	PrimeRemapping<uint32_t> remapping = table.compact();
+	std::vector<std::pair<uint32_t, uint32_t>> moved;
+
+	for (const auto& entry : remapping)
+	{
+		moved.emplace_back(entry.oldPrime, entry.newPrime);
+	}
+
+	CHECK((moved == std::vector<std::pair<uint32_t, uint32_t>>{ { 3, 2 }, { 7, 3 }, { 19, 5 }, { 23, 7 }, { 29, 11 } }));
+	CHECK(table.size() == 5 && table.getNumIndices() == 5);
+	CHECK(table.getPrime("value1") == 2 && table.getPrime("value9") == 11);
+	CHECK(table.add("next") == 13);
+
+	CHECK(product.getHash() == 2 * 7 * 7 * 11 && getSortedValues(product) == productValues);
+	CHECK(sparse.isSparse() && getSortedValues(sparse) == sparseValues);
+	CHECK(product.count("value8") == 2 && sparse.contains("value3") && !sparse.contains("value1"));
+	CHECK(table.getReferenceCount("value8") == 2 && table.getReferenceCount("value9") == 2);
+}
+
+/**
+	Reranking gives the most used values the smallest primes, and keeps the usage
+	and reference counts with the values. Bags that hold the values heavily are
+	re-encoded and still hold the same values.
+*/
+static void testRerank()
+{
+	StringTable table;
+	table.enableReranking();
+
+	for (int i = 0; i < 8; i++)
+	{
+		table.add("value" + std::to_string(i));
+	}
+
+	StringBag product(&table);
+	StringBag sparse(&table);
+	sparse.setFormThresholds(0, 0);
+
+	for (int count = 0; count < 4; count++)
+	{
+		product.add("value6");
+		product.add("value3");
+	}
+
+	product.add("value0");
+
+	for (const char* value : { "value6", "value6", "value7", "value7", "value1" })
+	{
+		sparse.add(value);
+	}
+
+	std::vector<std::string> productValues = getSortedValues(product);
+	std::vector<std::string> sparseValues = getSortedValues(sparse);
+
+	PrimeRemapping<uint32_t> remapping = table.rerank();
+
+	CHECK(remapping.map(17) == 2 && remapping.map(7) == 3 && remapping.map(19) == 5);
+
+	std::vector<uint32_t> primes;
+
+	for (int i : { 6, 3, 7, 0, 1, 2, 4, 5 })
+	{
+		primes.push_back(table.getPrime("value" + std::to_string(i)));
+	}
+
+	CHECK((primes == std::vector<uint32_t>{ 2, 3, 5, 7, 11, 13, 17, 19 }));
+	CHECK(table.getUsageCount("value6") == 7 && table.getUsageCount("value3") == 5 && table.getUsageCount("value2") == 1);
+	CHECK(table.getReferenceCount("value6") == 6 && table.getReferenceCount("value3") == 4 && table.getReferenceCount("value7") == 2);
+
+	CHECK(product.getHash() == 2 * 2 * 2 * 2 * 3 * 3 * 3 * 3 * 7 && getSortedValues(product) == productValues);
+	CHECK(sparse.isSparse() && getSortedValues(sparse) == sparseValues);
+	CHECK(product.count("value6") == 4 && sparse.count("value6") == 2 && !sparse.contains("value3"));
+}
+
+void runPrimeTableTests()
+{
+	testMapPolicies();
+	testAddAllRollback();
+	testHoleOrder();
+	testCompactRemapping();
+	testRerank();
+}
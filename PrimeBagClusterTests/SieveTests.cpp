@@ -0,0 +1,186 @@
+#include "Test.h"
+#include "SieveOfEratosthenes.h"
+#include "WheelSegmentSieve.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+	The primes the sieves are compared with go up to this number.
+*/
+static const ulong referenceLimit = 3000000;
+
+/**
+	Returns every prime below limit, found by crossing off the multiples of every
+	number one bit per number.
+*/
+static std::vector<uint> findReferencePrimes(ulong limit)
+{
+	std::vector<uint> primes;
+	std::vector<bool> composite(size_t(limit), false);
+
+	for (ulong number = 2; number < limit; number++)
+	{
+		if (!composite[size_t(number)])
+		{
+			primes.push_back(uint(number));
+
+			for (ulong multiple = number * number; multiple < limit; multiple += number)
+			{
+				composite[size_t(multiple)] = true;
+			}
+		}
+	}
+
+	return primes;
+}
+
+/**
+	Returns the reference primes from min up to max.
+*/
+static std::vector<uint> getReferenceRange(const std::vector<uint>& reference, ulong min, ulong max)
+{
+	auto first = std::lower_bound(reference.begin(), reference.end(), min, [](uint prime, ulong number) { return prime < number; });
+	auto last = std::upper_bound(reference.begin(), reference.end(), max, [](ulong number, uint prime) { return number < prime; });
+
+	return std::vector<uint>(first, last);
+}
+
+/**
+	Sieves segments up to max the way SieveOfEratosthenes drives the segment engine.
+	Before each segment, every reference prime below the next number whose square is
+	below the segment end is added. The primes inside a segment are found by the
+	engine itself.
+*/
+static void sieveUpTo(WheelSegmentSieve& engine, const std::vector<uint>& reference, size_t& numSievingPrimes, std::vector<uint>& out, ulong max)
+{
+	while (engine.getNextNumber() <= max)
+	{
+		ulong end = engine.getSegmentEnd();
+
+		for (; numSievingPrimes < reference.size() && ulong(reference[numSievingPrimes]) * reference[numSievingPrimes] < end &&
+			reference[numSievingPrimes] < engine.getNextNumber(); numSievingPrimes++)
+		{
+			engine.addSievingPrime(reference[numSievingPrimes]);
+		}
+
+		engine.sieveNextSegment(out, max);
+	}
+}
+
+/**
+	The segment engine finds the reference primes from starts that are not multiples
+	of 30, including 0 and 1 and starts above the square root of the range. The smallest segments
+	sieve almost every prime from a bucket.
+*/
+static void testSegmentEngine(const std::vector<uint>& reference)
+{
+	bool agree = true;
+
+	for (size_t segmentBytes : { size_t(64), size_t(100), size_t(4096) })
+	{
+		for (ulong min : { 0ull, 1ull, 2ull, 6ull, 7ull, 29ull, 31ull, 1000ull, 999983ull, 1000001ull })
+		{
+			WheelSegmentSieve engine(min, segmentBytes);
+			size_t numSievingPrimes = 0;
+			std::vector<uint> primes;
+			ulong max = min + 200000;
+
+			sieveUpTo(engine, reference, numSievingPrimes, primes, max);
+
+			agree &= primes == getReferenceRange(reference, min, max);
+		}
+	}
+
+	CHECK(agree);
+
+	/*
+		A range that ends among the primes the wheel leaves out.
+	*/
+	WheelSegmentSieve engine(0, 64);
+	std::vector<uint> primes;
+
+	engine.sieveNextSegment(primes, 3);
+
+	CHECK((primes == std::vector<uint>{ 2, 3 }));
+}
+
+/**
+	After seeking forward, to numbers that are not multiples of 30, the engine finds
+	the reference primes from there on. The sieving primes it had, in segments and
+	in buckets, are moved to the new position.
+*/
+static void testSeek(const std::vector<uint>& reference)
+{
+	bool agree = true;
+
+	for (size_t segmentBytes : { size_t(64), size_t(4096) })
+	{
+		WheelSegmentSieve engine(0, segmentBytes);
+		size_t numSievingPrimes = 0;
+		ulong max = 0;
+
+		for (ulong min : { 100000ull, 400007ull, 1234567ull, 1600001ull, 2500031ull })
+		{
+			std::vector<uint> primes;
+
+			engine.seek(min);
+			max = min + 100000;
+
+			sieveUpTo(engine, reference, numSievingPrimes, primes, max);
+
+			agree &= primes == getReferenceRange(reference, min, max);
+		}
+
+		/*
+			The segments after the last seek continue where it stopped.
+		*/
+		std::vector<uint> primes;
+		ulong next = engine.getNextNumber();
+
+		sieveUpTo(engine, reference, numSievingPrimes, primes, referenceLimit - 1);
+
+		agree &= primes == getReferenceRange(reference, next, referenceLimit - 1);
+	}
+
+	CHECK(agree);
+}
+
+/**
+	SieveOfEratosthenes finds the reference primes, one request at a time and all at
+	once.
+*/
+static void testSieve(const std::vector<uint>& reference)
+{
+	SieveOfEratosthenes<uint32_t> stepwise, direct;
+	bool agree = true;
+
+	for (size_t index = 0; index < reference.size(); index += 1 + index / 8)
+	{
+		agree &= stepwise.getPrimeNumber(index) == reference[index];
+	}
+
+	CHECK(agree);
+	CHECK(direct.getPrimeNumber(reference.size() - 1) == reference.back());
+
+	const PrimeStore<uint32_t>& primes = direct.getCalculatedPrimes();
+	agree = primes.size() >= reference.size();
+
+	for (size_t index = 0; index < reference.size() && agree; index++)
+	{
+		agree &= primes[index] == reference[index];
+	}
+
+	CHECK(agree);
+}
+
+void runSieveTests()
+{
+	std::vector<uint> reference = findReferencePrimes(referenceLimit);
+
+	testSegmentEngine(reference);
+	testSeek(reference);
+	testSieve(reference);
+}
@@ -0,0 +1,218 @@
+#include "Test.h"
+#include "PrimeTable.h"
+
+#include <memory>
+#include <string>
+#include <cstdint>
+
+typedef PrimeTable<std::string> StringTable;
+
+/**
+	Returns the bucket a single recorded value lands in, or HistogramSnapshot::numBuckets
+	if it lands in none.
+*/
+static size_t getBucketOf(uint64_t value)
+{
+	StatisticsHistogram histogram;
+	histogram.record(value);
+
+	HistogramSnapshot snapshot = histogram.snapshot();
+
+	for (size_t bucket = 0; bucket < HistogramSnapshot::numBuckets; bucket++)
+	{
+		if (snapshot.buckets[bucket])
+		{
+			return bucket;
+		}
+	}
+
+	return HistogramSnapshot::numBuckets;
+}
+
+/**
+	Zero has a bucket of its own, and every power of two starts a new bucket that
+	the value before it is not in. The largest values share the last bucket.
+*/
+static void testHistogramBuckets()
+{
+#ifndef PRIMEBAG_NO_STATISTICS
+	CHECK(getBucketOf(0) == 0);
+	CHECK(getBucketOf(1) == 1);
+	CHECK(getBucketOf(UINT64_MAX) == 64);
+
+	bool bounded = true;
+
+	for (size_t bit = 1; bit < 64; bit++)
+	{
+		uint64_t power = uint64_t(1) << bit;
+
+		bounded &= getBucketOf(power - 1) == bit && getBucketOf(power) == bit + 1;
+	}
+
+	CHECK(bounded);
+#else
+	CHECK(getBucketOf(1) == HistogramSnapshot::numBuckets);
+#endif
+
+	/*
+		The totals, and the quantiles that end at the bucket of the value they reach.
+	*/
+	StatisticsHistogram histogram;
+
+	CHECK(histogram.snapshot().quantile(0.5) == 0);
+
+	for (uint64_t value : { 0, 0, 0, 5, 1000 })
+	{
+		histogram.record(value);
+	}
+
+	HistogramSnapshot snapshot = histogram.snapshot();
+
+#ifndef PRIMEBAG_NO_STATISTICS
+	CHECK(snapshot.count == 5 && snapshot.sum == 1005);
+	CHECK(snapshot.buckets[0] == 3 && snapshot.buckets[3] == 1 && snapshot.buckets[10] == 1);
+	CHECK(snapshot.quantile(0.5) == 0 && snapshot.quantile(0.8) == 7 && snapshot.quantile(1.0) == 1023);
+
+	histogram.record(UINT64_MAX);
+
+	CHECK(histogram.snapshot().quantile(1.0) == UINT64_MAX);
+#else
+	CHECK(snapshot.count == 0 && snapshot.sum == 0 && snapshot.buckets[0] == 0);
+	CHECK(snapshot.quantile(1.0) == 0);
+#endif
+}
+
+/**
+	A counter adds up and can be set as a gauge, and a timer does not go back.
+*/
+static void testCounterAndTimer()
+{
+	StatisticsCounter counter;
+	counter.add();
+	counter.add(4);
+
+	uint64_t added = counter.load();
+
+	counter.set(2);
+
+	StatisticsTimer timer;
+	uint64_t first = timer.getNanoseconds();
+	uint64_t second = timer.getNanoseconds();
+
+#ifndef PRIMEBAG_NO_STATISTICS
+	CHECK(added == 5 && counter.load() == 2);
+	CHECK(second >= first);
+#else
+	CHECK(added == 0 && counter.load() == 0);
+	CHECK(first == 0 && second == 0);
+#endif
+}
+
+/**
+	The counters of a table follow its adds, removes and remappings. The gauges are
+	read from the table, so they are there even when the counters are compiled out.
+*/
+static void testTableStatistics()
+{
+	StringTable table(std::make_shared<PrimeSource<uint32_t>>());
+
+	table.add("a");
+	table.add("b");
+	table.add("c");
+	table.add("a");
+	table.remove("b");
+	table.remove("missing");
+	table.add("d");
+
+	std::string more[] = { "a", "e", "f" };
+	uint32_t primes[3];
+	table.addAll(std::begin(more), std::end(more), primes);
+
+	table.compact();
+	table.rerank();
+
+	PrimeTableStatistics statistics = table.getStatistics();
+
+	CHECK(statistics.numValues == 5 && statistics.highestPrime == 11);
+	CHECK(statistics.mapCapacity >= 5 && statistics.getLoadFactor() > 0);
+	CHECK(statistics.sieve.numPrimes >= 5);
+
+#ifndef PRIMEBAG_NO_STATISTICS
+	CHECK(statistics.numHits == 2 && statistics.numMisses == 6);
+	CHECK(statistics.numHoleReuses == 1 && statistics.numRemoves == 1);
+	CHECK(statistics.numRemappings == 2);
+	CHECK(statistics.lookahead.numPopped == 3);
+	CHECK(statistics.sieve.numPasses >= 1 && statistics.sieve.passNanoseconds.count == statistics.sieve.numPasses);
+#else
+	CHECK(statistics.numHits == 0 && statistics.numMisses == 0 && statistics.numRemoves == 0);
+	CHECK(statistics.lookahead.numPopped == 0 && statistics.sieve.numPasses == 0);
+#endif
+}
+
+/**
+	A request the sieve has the primes for already is not a pass, and a large one
+	on several threads sieves in parallel.
+*/
+static void testSieveStatistics()
+{
+	SieveOfEratosthenes<uint32_t> sieve;
+	sieve.setNumThreads(1);
+	sieve.getPrimeNumber(999);
+	sieve.getPrimeNumber(10);
+
+	SieveStatistics statistics = sieve.getStatistics();
+
+	CHECK(statistics.numPrimes >= 1000);
+
+#ifndef PRIMEBAG_NO_STATISTICS
+	CHECK(statistics.numPasses == 1 && statistics.numSegments >= 1 && statistics.numParallelPasses == 0);
+	CHECK(statistics.passNanoseconds.count == 1);
+#else
+	CHECK(statistics.numPasses == 0 && statistics.numSegments == 0);
+#endif
+
+	sieve.setNumThreads(4);
+	sieve.getPrimeNumber(3000000);
+	statistics = sieve.getStatistics();
+
+#ifndef PRIMEBAG_NO_STATISTICS
+	CHECK(statistics.numPasses == 2 && statistics.numParallelPasses == 1);
+#else
+	CHECK(statistics.numParallelPasses == 0);
+#endif
+}
+
+/**
+	Every popped prime is counted, and the stall histogram holds every stall and
+	the time the stalls took in total.
+*/
+static void testLookaheadStatistics()
+{
+	PrimeSource<uint32_t> source;
+	PrimeLookahead<uint32_t, PrimeStore<uint32_t>> lookahead(source, 8, 2);
+
+	for (int count = 0; count < 1000; count++)
+	{
+		lookahead.pop();
+	}
+
+	PrimeLookaheadStatistics statistics = lookahead.getStatistics();
+
+#ifndef PRIMEBAG_NO_STATISTICS
+	CHECK(statistics.numPopped == 1000 && statistics.numProduced >= 1000);
+	CHECK(statistics.numProducerWakeups >= 1 && statistics.numStalls >= 1);
+	CHECK(statistics.stallTimes.count == statistics.numStalls && statistics.stallTimes.sum == statistics.stallNanoseconds);
+#else
+	CHECK(statistics.numPopped == 0 && statistics.numProduced == 0 && statistics.numStalls == 0);
+	CHECK(statistics.stallTimes.count == 0);
+#endif
+}
+
+void runStatisticsTests()
+{
+	testHistogramBuckets();
+	testCounterAndTimer();
+	testTableStatistics();
+	testSieveStatistics();
+	testLookaheadStatistics();
+}
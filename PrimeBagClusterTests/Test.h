@@ -0,0 +1,28 @@
+#pragma once
+
+/**
+	The tests are plain functions that check conditions with CHECK. A failed check
+	is reported with its file and line, and the remaining checks still run. main
+	runs every test and returns the number of failed checks, so the tests pass when
+	it returns 0.
+*/
+#define CHECK(condition) checkCondition(bool(condition), #condition, __FILE__, __LINE__)
+
+/**
+	Reports a condition that does not hold and counts it as a failure. Returns the
+	condition, so a test can stop early when a failed check makes the rest moot.
+	This may be called from any thread.
+*/
+bool checkCondition(bool condition, const char* expression, const char* file, int line);
+
+void runChunkedArrayTests();
+void runPrimeLookaheadTests();
+void runConcurrentPrimeTableTests();
+void runWordDivisorTests();
+void runPrimeBagTests();
+void runPrimeTableTests();
+void runPrimeTableFileTests();
+void runPrimeFileTests();
+void runSieveTests();
+void runCompactPrimeStoreTests();
+void runStatisticsTests();
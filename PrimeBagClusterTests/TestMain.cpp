@@ -0,0 +1,47 @@
+#include "Test.h"
+
+#include <atomic>
+#include <iostream>
+#include <mutex>
+
+static std::atomic<int> numFailures(0);
+static std::mutex outputMutex;
+
+bool checkCondition(bool condition, const char* expression, const char* file, int line)
+{
+	if (!condition)
+	{
+		numFailures++;
+
+		std::lock_guard<std::mutex> lock(outputMutex);
+		std::cerr << file << "(" << line << "): check failed: " << expression << std::endl;
+	}
+
+	return condition;
+}
+
+int main()
+{
+	runChunkedArrayTests();
+	runPrimeLookaheadTests();
+	runConcurrentPrimeTableTests();
+	runWordDivisorTests();
+	runPrimeBagTests();
+	runPrimeTableTests();
+	runPrimeTableFileTests();
+	runPrimeFileTests();
+	runSieveTests();
+	runCompactPrimeStoreTests();
+	runStatisticsTests();
+
+	if (numFailures)
+	{
+		std::cerr << numFailures << " checks failed" << std::endl;
+	}
+	else
+	{
+		std::cout << "All tests passed" << std::endl;
+	}
+
+	return numFailures;
+}
@@ -0,0 +1,156 @@
+#include "Test.h"
+#include "WordDivisor.h"
+
+#include <random>
+#include <vector>
+#include <cstdint>
+
+typedef boost::multiprecision::cpp_int bignum;
+
+/**
+	Odd primes of every size up to 64 bits, the one even prime, and a few odd
+	composites, which the kernel has to handle just the same.
+*/
+static const uint64_t divisors[] = {
+	2, 3, 5, 7, 11, 13, 251, 257, 65521, 65537, 1000003, 2147483647, 2147483659ull,
+	4294967291ull, 4294967311ull, 1099511627791ull, 18446744073709551557ull, 9, 15, 4294967295ull
+};
+
+/**
+	Compares divides, divideExact and divideOut on native words with the operators
+	of the word.
+*/
+template <typename Word>
+static bool checkWord(const WordDivisor& divisor, Word number)
+{
+	Word prime = Word(divisor.getPrime());
+	bool result = divisor.divides(number) == !(number % prime);
+
+	if (!(number % prime))
+	{
+		Word quotient = number;
+		divisor.divideExact(quotient);
+		result &= quotient == number / prime;
+	}
+
+	Word remaining = number;
+	uint multiplicity = 0;
+
+	for (Word left = number; left && !(left % prime); left /= prime)
+	{
+		multiplicity++;
+	}
+
+	if (number)
+	{
+		result &= divisor.divideOut(remaining) == multiplicity && remaining % prime;
+	}
+
+	return result;
+}
+
+static bool checkBignum(const WordDivisor& divisor, const bignum& number)
+{
+	bignum prime = divisor.getPrime();
+	bool multiple = !(number % prime);
+	bool result = divisor.divides(number) == multiple;
+
+	if (multiple)
+	{
+		bignum quotient = number;
+		divisor.divideExact(quotient);
+		result &= quotient == number / prime;
+	}
+
+	return result;
+}
+
+static void testInverse()
+{
+	bool inverse = true;
+
+	for (uint64_t divisor : divisors)
+	{
+		uint64_t result = WordDivisor::invert(divisor);
+
+		inverse &= divisor & 1 ? divisor * result == 1 : !result;
+	}
+
+	CHECK(inverse);
+}
+
+/**
+	Tests every divisor against random numbers and random multiples of it, as 64-bit
+	and 128-bit words and as bignums of up to 16 limbs.
+*/
+static void testAgainstRemainder()
+{
+	std::mt19937_64 random(12345);
+
+	bool words = true;
+	bool wideWords = true;
+	bool bignums = true;
+
+	for (uint64_t prime : divisors)
+	{
+		WordDivisor divisor(prime);
+
+		for (int round = 0; round < 2000; round++)
+		{
+			uint64_t number = random() >> (round % 64);
+
+			words &= checkWord(divisor, number);
+			words &= checkWord(divisor, uint64_t(number % (~uint64_t(0) / prime + 1)) * prime);
+
+#ifdef __SIZEOF_INT128__
+			unsigned __int128 wide = (unsigned __int128)(random()) << 64 | random();
+
+			wideWords &= checkWord(divisor, wide);
+			wideWords &= checkWord(divisor, (wide >> 64) * prime);
+#endif
+
+			bignum big = 0;
+
+			for (int limb = round % 16; limb >= 0; limb--)
+			{
+				big = (big << 64) | random();
+			}
+
+			bignums &= checkBignum(divisor, big);
+			bignums &= checkBignum(divisor, big * prime);
+			bignums &= checkBignum(divisor, big * prime * prime + prime);
+			bignums &= checkBignum(divisor, big * prime + 1);
+		}
+
+		/*
+			Zero is divisible by everything, and a power of the prime divides out
+			completely.
+		*/
+		bignums &= checkBignum(divisor, bignum(0));
+
+		bignum power = boost::multiprecision::pow(bignum(prime), 12);
+
+		bignums &= divisor.divideOut(power) == 12 && power == 1;
+	}
+
+	CHECK(words);
+	CHECK(wideWords);
+	CHECK(bignums);
+}
+
+/**
+	An empty divisor stands for a value without a prime.
+*/
+static void testEmpty()
+{
+	WordDivisor divisor;
+
+	CHECK(divisor.getPrime() == 0);
+}
+
+void runWordDivisorTests()
+{
+	testInverse();
+	testAgainstRemainder();
+	testEmpty();
+}
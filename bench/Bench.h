@@ -0,0 +1,49 @@
+#pragma once
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+/**
+	The benchmarks are plain programs that time two ways of doing the same work and
+	print both times. Each run repeats the work a few times and reports the fastest
+	run, which is the least disturbed by the rest of the machine. A benchmark returns
+	nonzero if the two ways disagree on the result.
+*/
+static const int numBenchmarkRuns = 5;
+
+/**
+	Runs a function numBenchmarkRuns times and returns the fastest run in
+	milliseconds.
+*/
+template <typename Function>
+double timeFastestRun(Function function)
+{
+	double fastest = 0;
+
+	for (int run = 0; run < numBenchmarkRuns; run++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		function();
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+		if (!run || elapsed.count() < fastest)
+		{
+			fastest = elapsed.count();
+		}
+	}
+
+	return fastest;
+}
+
+/**
+	Prints the time of a benchmarked function next to the time of the function it
+	is compared against.
+*/
+inline void printComparison(const std::string& name, double baselineMilliseconds, double milliseconds)
+{
+	std::cout << std::left << std::setw(40) << name << std::right << std::fixed << std::setprecision(2)
+		<< std::setw(10) << baselineMilliseconds << " ms" << std::setw(10) << milliseconds << " ms"
+		<< std::setw(8) << baselineMilliseconds / milliseconds << "x" << std::endl;
+}
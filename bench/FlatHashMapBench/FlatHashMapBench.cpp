@@ -0,0 +1,122 @@
+#include "Bench.h"
+#include "FlatHashMap.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+	Inserts every key with its position as the value into an empty map.
+*/
+template <typename Map, typename K>
+static void insertAll(Map& map, const std::vector<K>& keys)
+{
+	map.clear();
+
+	for (size_t index = 0; index < keys.size(); index++)
+	{
+		map.emplace(keys[index], uint32_t(index));
+	}
+}
+
+/**
+	Looks every key up and returns the sum of the values found, so that the lookups
+	cannot be optimized away. Half of the keys are not in the map.
+*/
+template <typename Map, typename K>
+static uint64_t findAll(const Map& map, const std::vector<K>& keys)
+{
+	uint64_t sum = 0;
+
+	for (const K& key : keys)
+	{
+		auto iter = map.find(key);
+
+		if (iter != map.end())
+		{
+			sum += iter->second;
+		}
+	}
+
+	return sum;
+}
+
+/**
+	Times inserts and lookups of the same keys in a std::unordered_map and in a
+	FlatHashMap. Returns false if the maps disagree.
+*/
+template <typename K>
+static bool compareMaps(const std::string& name, const std::vector<K>& keys, const std::vector<K>& lookups)
+{
+	std::unordered_map<K, uint32_t> nodeMap;
+	FlatHashMap<K, uint32_t> flatMap;
+
+	double nodeInsert = timeFastestRun([&]() { insertAll(nodeMap, keys); });
+	double flatInsert = timeFastestRun([&]() { insertAll(flatMap, keys); });
+
+	uint64_t nodeSum = 0, flatSum = 0;
+
+	double nodeFind = timeFastestRun([&]() { nodeSum = findAll(nodeMap, lookups); });
+	double flatFind = timeFastestRun([&]() { flatSum = findAll(flatMap, lookups); });
+
+	if (nodeMap.size() != flatMap.size() || nodeSum != flatSum)
+	{
+		std::cerr << "The maps disagree on the " << name << std::endl;
+		return false;
+	}
+
+	printComparison("Insert " + name, nodeInsert, flatInsert);
+	printComparison("Find " + name, nodeFind, flatFind);
+
+	return true;
+}
+
+/**
+	Compares FlatHashMap with std::unordered_map for as many distinct random integer
+	and string keys as the first argument gives, 10^6 by default. The lookups hit and
+	miss equally often.
+*/
+int main(int argc, char** argv)
+{
+	size_t numKeys = argc > 1 ? size_t(std::strtoull(argv[1], nullptr, 10)) : 1000000;
+
+	std::mt19937_64 random(13);
+
+	/*
+		The keys are distinct, and the even ones are inserted while the odd ones only
+		miss. Multiplying by an odd number permutes the integers, so it scatters them
+		and keeps their parity.
+	*/
+	std::vector<uint32_t> integerKeys, integerLookups;
+	std::vector<std::string> stringKeys, stringLookups;
+
+	for (size_t index = 0; index < 2 * numKeys; index++)
+	{
+		uint32_t key = uint32_t(index) * 2654435761u;
+		std::string stringKey = "value-" + std::to_string(random() % 1000000) + "-" + std::to_string(index);
+
+		if (index % 2 == 0)
+		{
+			integerKeys.push_back(key);
+			stringKeys.push_back(stringKey);
+		}
+
+		integerLookups.push_back(key);
+		stringLookups.push_back(stringKey);
+	}
+
+	std::shuffle(integerLookups.begin(), integerLookups.end(), random);
+	std::shuffle(stringLookups.begin(), stringLookups.end(), random);
+
+	std::cout << numKeys << " keys, std::unordered_map against FlatHashMap" << std::endl;
+
+	bool agree = compareMaps("integer keys", integerKeys, integerLookups);
+	agree &= compareMaps("string keys", stringKeys, stringLookups);
+
+	return agree ? 0 : 1;
+}
@@ -0,0 +1,197 @@
+#include "Bench.h"
+#include "WheelSegmentSieve.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+/**
+	The primes that the pre-sieve patterns cross off.
+*/
+static const uint presievedPrimes[] = { 7, 11, 13, 17, 19, 23 };
+
+/**
+	This is how a segment was filled before the pre-sieve patterns. It starts with
+	every bit set, and each small prime is crossed off with a strided loop over the
+	bytes of its residue classes.
+*/
+static void fillByCrossingOff(std::vector<uint8_t>& segment, ulong base)
+{
+	std::fill(segment.begin(), segment.end(), uint8_t(0xFF));
+
+	ulong high = base + 30 * ulong(segment.size());
+
+	for (uint prime : presievedPrimes)
+	{
+		ulong start = std::max(ulong(prime) * prime, base);
+
+		for (uint residue : wheelResidues)
+		{
+			ulong q = (start + prime - 1) / prime;
+			q += (residue + 30 - q % 30) % 30;
+
+			ulong multiple = q * prime;
+
+			if (multiple >= high)
+			{
+				continue;
+			}
+
+			uint8_t mask = uint8_t(~(1u << wheelBitIndex[multiple % 30]));
+
+			for (size_t index = size_t((multiple - base) / 30); index < segment.size(); index += prime)
+			{
+				segment[index] &= mask;
+			}
+		}
+	}
+}
+
+/**
+	A pre-sieve pattern for the primes of one group, repeating every period bytes.
+*/
+struct Pattern
+{
+	size_t period;
+	std::vector<uint8_t> bytes;
+};
+
+static Pattern makePattern(uint first, uint second, uint third)
+{
+	Pattern pattern;
+	pattern.period = first * second * third;
+	pattern.bytes.assign(pattern.period, uint8_t(0xFF));
+
+	for (size_t index = 0; index < pattern.period; index++)
+	{
+		for (uint bit = 0; bit < 8; bit++)
+		{
+			ulong number = 30 * ulong(index) + wheelResidues[bit];
+
+			if (number % first == 0 || number % second == 0 || number % third == 0)
+			{
+				pattern.bytes[index] &= uint8_t(~(1u << bit));
+			}
+		}
+	}
+
+	return pattern;
+}
+
+/**
+	This combines the same two patterns as WheelSegmentSieve::presieve, but one byte
+	at a time, so it shows what the vector loads gain.
+*/
+static void fillBytewise(std::vector<uint8_t>& segment, ulong base, const Pattern& first, const Pattern& second)
+{
+	size_t firstOffset = size_t(base / 30 % first.period);
+	size_t secondOffset = size_t(base / 30 % second.period);
+
+	for (uint8_t& byte : segment)
+	{
+		byte = first.bytes[firstOffset] & second.bytes[secondOffset];
+
+		if (++firstOffset == first.period)
+		{
+			firstOffset = 0;
+		}
+
+		if (++secondOffset == second.period)
+		{
+			secondOffset = 0;
+		}
+	}
+
+	/*
+		The patterns cross off the pre-sieved primes themselves.
+	*/
+	if (base == 0)
+	{
+		for (uint prime : presievedPrimes)
+		{
+			segment[0] |= uint8_t(1u << wheelBitIndex[prime]);
+		}
+	}
+}
+
+/**
+	Fills consecutive segments with one method and returns a checksum of their
+	bytes, so that the fills cannot be optimized away.
+*/
+template <typename Fill>
+static ulong fillSegments(std::vector<uint8_t>& segment, size_t numSegments, Fill fill)
+{
+	ulong checksum = 0;
+	ulong base = 0;
+
+	for (size_t index = 0; index < numSegments; index++, base += 30 * ulong(segment.size()))
+	{
+		fill(segment, base);
+		checksum = checksum * 31 + segment[index % segment.size()];
+	}
+
+	return checksum;
+}
+
+/**
+	Compares the pre-sieve pattern fill with crossing off the small primes and with
+	a byte-wise pattern fill, over as many L1-sized segments as the first argument
+	gives, 10000 by default.
+*/
+int main(int argc, char** argv)
+{
+	size_t numSegments = argc > 1 ? size_t(std::strtoull(argv[1], nullptr, 10)) : 10000;
+	size_t segmentBytes = WheelSegmentSieve::detectCacheSize();
+
+	Pattern first = makePattern(7, 11, 13), second = makePattern(17, 19, 23);
+
+	auto crossOff = [](std::vector<uint8_t>& segment, ulong base) { fillByCrossingOff(segment, base); };
+	auto bytewise = [&](std::vector<uint8_t>& segment, ulong base) { fillBytewise(segment, base, first, second); };
+	auto presieve = [](std::vector<uint8_t>& segment, ulong base) { WheelSegmentSieve::presieve(segment.data(), segment.size(), base); };
+
+	/*
+		Every method has to produce the same bytes, including the first segment,
+		which holds the pre-sieved primes themselves.
+	*/
+	std::vector<uint8_t> expected(segmentBytes), segment(segmentBytes);
+
+	for (ulong base = 0; base < 30 * ulong(segmentBytes) * 16; base += 30 * ulong(segmentBytes))
+	{
+		fillByCrossingOff(expected, base);
+		bytewise(segment, base);
+
+		if (segment != expected)
+		{
+			std::cerr << "The byte-wise pattern fill differs at " << base << std::endl;
+			return 1;
+		}
+
+		presieve(segment, base);
+
+		if (segment != expected)
+		{
+			std::cerr << "The pattern fill differs at " << base << std::endl;
+			return 1;
+		}
+	}
+
+	std::cout << numSegments << " segments of " << segmentBytes << " bytes" << std::endl;
+
+	ulong checksums[3];
+
+	double crossOffTime = timeFastestRun([&]() { checksums[0] = fillSegments(segment, numSegments, crossOff); });
+	double bytewiseTime = timeFastestRun([&]() { checksums[1] = fillSegments(segment, numSegments, bytewise); });
+	double presieveTime = timeFastestRun([&]() { checksums[2] = fillSegments(segment, numSegments, presieve); });
+
+	if (checksums[1] != checksums[0] || checksums[2] != checksums[0])
+	{
+		std::cerr << "The fills disagree on the checksum of the segments" << std::endl;
+		return 1;
+	}
+
+	printComparison("Crossing off against pattern fill", crossOffTime, presieveTime);
+	printComparison("Byte-wise against pattern fill", bytewiseTime, presieveTime);
+
+	return 0;
+}
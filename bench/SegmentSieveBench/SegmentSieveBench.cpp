@@ -0,0 +1,178 @@
+#include "Bench.h"
+#include "WheelSegmentSieve.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+/**
+	This is how segments were crossed off before the segment engine. The next multiple
+	of a prime is recalculated from prime ^ 2 in every segment, for every residue
+	class.
+*/
+static void crossOffMultiplesInSegment(std::vector<uint8_t>& segment, uint prime, ulong base)
+{
+	ulong high = base + 30 * ulong(segment.size());
+	ulong start = std::max(ulong(prime) * prime, base);
+
+	for (uint residue : wheelResidues)
+	{
+		ulong q = (start + prime - 1) / prime;
+		q += (residue + 30 - q % 30) % 30;
+
+		ulong multiple = q * prime;
+
+		if (multiple >= high)
+		{
+			continue;
+		}
+
+		uint8_t mask = uint8_t(~(1u << wheelBitIndex[multiple % 30]));
+
+		for (size_t index = size_t((multiple - base) / 30); index < segment.size(); index += prime)
+		{
+			segment[index] &= mask;
+		}
+	}
+}
+
+/**
+	This is the serial loop before the segment engine. Each segment spans about the
+	square root of a limit that doubles as the sieve goes on, and every prime below
+	the square root of its end is walked again for it.
+*/
+static std::vector<uint> sieveWithRecalculatedMultiples(ulong max)
+{
+	std::vector<uint> primes;
+	std::vector<uint8_t> segment;
+	ulong highestTestedNum = 1, sieveLimit = 1;
+
+	while (highestTestedNum < max)
+	{
+		ulong min = highestTestedNum + 1;
+
+		while (sieveLimit <= min)
+		{
+			sieveLimit *= 2;
+		}
+
+		ulong segmentMax = std::min(sieveLimit, min + ulong(std::sqrt(double(sieveLimit))));
+		segmentMax += 29 - segmentMax % 30;
+
+		ulong base = min - min % 30;
+		segment.assign(size_t((segmentMax - base) / 30 + 1), 0xFF);
+
+		ulong high = base + 30 * ulong(segment.size());
+
+		for (uint prime : { 2u, 3u, 5u })
+		{
+			if (prime >= min && prime <= segmentMax)
+			{
+				primes.push_back(prime);
+			}
+		}
+
+		for (uint prime : primes)
+		{
+			if (ulong(prime) * prime >= high)
+			{
+				break;
+			}
+
+			if (prime > 5)
+			{
+				crossOffMultiplesInSegment(segment, prime, base);
+			}
+		}
+
+		size_t numKnownPrimes = primes.size();
+
+		for (size_t index = 0; index < segment.size(); index++)
+		{
+			for (uint bit = 0, bits = segment[index]; bits; bit++, bits >>= 1)
+			{
+				ulong number = base + 30 * ulong(index) + wheelResidues[bit];
+
+				if (!(bits & 1) || number < min || number > segmentMax)
+				{
+					continue;
+				}
+
+				if (number * number < high)
+				{
+					crossOffMultiplesInSegment(segment, uint(number), base);
+				}
+
+				primes.push_back(uint(number));
+			}
+		}
+
+		/*
+			The old loop handed out every prime of a segment, so only the last segment may
+			have to be cut back to max.
+		*/
+		if (segmentMax > max)
+		{
+			primes.erase(std::upper_bound(primes.begin() + numKnownPrimes, primes.end(), uint(max)), primes.end());
+		}
+
+		highestTestedNum = segmentMax;
+	}
+
+	return primes;
+}
+
+/**
+	This drives the segment engine the way SieveOfEratosthenes does on one thread.
+	Each sieving prime is added once, shortly before its square is reached, and keeps
+	its next multiples from segment to segment.
+*/
+static std::vector<uint> sieveWithSegmentEngine(ulong max)
+{
+	std::vector<uint> primes;
+	WheelSegmentSieve engine(2);
+	size_t numSievingPrimes = 0;
+
+	while (engine.getNextNumber() <= max)
+	{
+		ulong end = engine.getSegmentEnd();
+
+		for (; numSievingPrimes < primes.size() && ulong(primes[numSievingPrimes]) * primes[numSievingPrimes] < end; numSievingPrimes++)
+		{
+			engine.addSievingPrime(primes[numSievingPrimes]);
+		}
+
+		engine.sieveNextSegment(primes, max);
+	}
+
+	return primes;
+}
+
+/**
+	Compares the segment engine with the loop it replaced by sieving every prime up
+	to the number given as the first argument, 10^8 by default, on one thread.
+*/
+int main(int argc, char** argv)
+{
+	ulong max = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000000;
+
+	std::vector<uint> expected = sieveWithRecalculatedMultiples(max);
+	std::vector<uint> primes = sieveWithSegmentEngine(max);
+
+	if (primes != expected)
+	{
+		std::cerr << "The segment engine found " << primes.size() << " primes up to " << max << ", the old loop " << expected.size() << std::endl;
+		return 1;
+	}
+
+	std::cout << primes.size() << " primes up to " << max << ", old loop against segment engine" << std::endl;
+
+	double baseline = timeFastestRun([max]() { sieveWithRecalculatedMultiples(max); });
+	double engine = timeFastestRun([max]() { sieveWithSegmentEngine(max); });
+
+	printComparison("Sieve", baseline, engine);
+
+	return 0;
+}